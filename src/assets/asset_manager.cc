@@ -2,6 +2,10 @@
 
 #include "std/arr.h"
 #include "std/hashset.h"
+#include "std/pool.h"
+#include "std/memtrack.h"
+
+#include "core/thread_pool.h"
 
 #include "gfx/engine.h"
 
@@ -14,71 +18,74 @@
 
 template<typename T>
 struct AssetListManager {
-    AssetListManager() {
-        arena = Arena::make(gb(1), Arena::Virtual);
-    }
+    // any value the debug poison or a cleared flag can't be
+    static constexpr u32 kalive = 0xA11FE;
+
+    // the event lives next to the value, the pool never moves them so jobs can stay parked on it
+    struct Entry {
+        T value;
+        JobEvent loaded;
+        // freed slots stay readable, destroy clears this so stale handles are rejected
+        std::atomic<u32> alive = kalive;
+    };
 
     void cleanup() {
-        for (u32 i = 0; i < count; ++i) {
-            values[i].~T();
-        }
+        entries.cleanup();
     }
 
-    T *get(Handle<T> handle) {
+    Entry *getEntry(Handle<T> handle) {
         u32 index = handle.value;
-        if (index >= count) return nullptr;
-        if (!is_loaded[index]) return nullptr;
-        return &values[index];
+        if (index >= entries.size()) return nullptr;
+        Entry *entry = entries.fromIndex(index);
+        if (entry->alive.load(std::memory_order_acquire) != kalive) return nullptr;
+        return entry;
+    }
+
+    T *get(Handle<T> handle) {
+        Entry *entry = getEntry(handle);
+        if (!entry || !entry->loaded.isSet()) return nullptr;
+        return &entry->value;
     }
 
     void destroy(Handle<T> handle) {
-        u32 index = handle.value;
-        if (index >= count) return;
-        values[index].~T();
-        is_loaded[index] = false;
-        freelist.push(index);
+        Entry *entry = getEntry(handle);
+        if (!entry) return;
+        entry->loaded.reset();
+        entry->alive.store(0, std::memory_order_release);
+        entries.freeIndex(handle.value);
     }
 
     bool isLoaded(Handle<T> handle) {
-        u32 index = handle.value;
-        if (index >= count) return false;
-        return is_loaded[index];
+        Entry *entry = getEntry(handle);
+        return entry && entry->loaded.isSet();
+    }
+
+    void waitUntilLoaded(Handle<T> handle) {
+        if (Entry *entry = getEntry(handle)) {
+            entry->loaded.wait();
+        }
     }
 
     void startLoading(Handle<T> handle) {
-        u32 index = handle.value;
-        if (index >= count) return;
-        is_loaded[index] = false;
+        if (Entry *entry = getEntry(handle)) {
+            entry->loaded.reset();
+        }
     }
 
     void finishLoading(Handle<T> handle, T &&asset) {
-        u32 index = handle.value;
-        if (index >= count) return;
-        is_loaded[index] = true;
-        values[index] = mem::move(asset);
+        Entry *entry = getEntry(handle);
+        if (!entry) return;
+        entry->value = mem::move(asset);
+        // only wake up the waiting jobs once the value is there
+        entry->loaded.signal();
     }
 
     Handle<T> getNewHandle() {
-        if (freelist.empty()) {
-            u32 index = (u32)count;
-            is_loaded.push(false);
-            // arena is only used by values, meaning it will be one big list
-            arena.alloc<T>();
-            values = (T *)arena.start;
-            ++count;
-            return index;
-        }
-
-        u32 index = freelist.back();
-        freelist.pop();
-        return index;
+        return entries.allocIndex();
     }
 
-    T *values;
-    u32 count = 0;
-    arr<bool> is_loaded;
-    arr<u32> freelist;
-    Arena arena;
+    // handles are requested from the loading jobs too
+    Pool<Entry, true> entries;
 };
 
 #define MAKE_MANAGER(type, prefix)                                                                                                           \
@@ -86,6 +93,7 @@ struct AssetListManager {
     type *AssetManager::get(Handle<type> handle)                        { return prefix##_manager.get(handle); }                             \
     void AssetManager::destroy(Handle<type> handle)                     { return prefix##_manager.destroy(handle); }                         \
     bool AssetManager::isLoaded(Handle<type> handle)                    { return prefix##_manager.isLoaded(handle); }                        \
+    void AssetManager::waitUntilLoaded(Handle<type> handle)             { return prefix##_manager.waitUntilLoaded(handle); }                 \
     void AssetManager::startLoading(Handle<type> handle)                { return prefix##_manager.startLoading(handle); }                    \
     void AssetManager::finishLoading(Handle<type> handle, type &&asset) { return prefix##_manager.finishLoading(handle, mem::move(asset)); } \
     Handle<type> AssetManager::getNew##type##Handle()                   { return prefix##_manager.getNewHandle(); }
@@ -97,6 +105,7 @@ MAKE_MANAGER(Buffer, buf);
 // PUBLIC FUNCTIONS //////////////////////////////////////////////////////////////////////////////
 
 void AssetManager::loadDefaults() {
+    memtrack::TagScope mem_tag(MemTag::Assets);
     Handle<Texture> default_texture = Texture::load("default.png");
     buf_manager.getNewHandle();
     //// wait for the default texture to load
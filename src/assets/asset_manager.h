@@ -10,6 +10,8 @@ struct Handle {
     Handle(u32 value) : value(value) {}
 
     bool isLoaded() const;
+    // parks the current job until the asset is loaded
+    void waitUntilLoaded() const;
     T *get() const;
 
     operator bool() const { return value != 0; }
@@ -31,6 +33,7 @@ namespace AssetManager {
     Texture *get(Handle<Texture> handle);
     void destroy(Handle<Texture> handle);
     bool isLoaded(Handle<Texture> handle);
+    void waitUntilLoaded(Handle<Texture> handle);
     void startLoading(Handle<Texture> handle);
     void finishLoading(Handle<Texture> handle, Texture &&asset);
     Handle<Texture> getNewTextureHandle();
@@ -40,6 +43,7 @@ namespace AssetManager {
     Descriptor *get(Handle<Descriptor> handle);
     void destroy(Handle<Descriptor> handle);
     bool isLoaded(Handle<Descriptor> handle);
+    void waitUntilLoaded(Handle<Descriptor> handle);
     void startLoading(Handle<Descriptor> handle);
     void finishLoading(Handle<Descriptor> handle, Descriptor &&asset);
     Handle<Descriptor> getNewDescriptorHandle();
@@ -49,6 +53,7 @@ namespace AssetManager {
     Buffer *get(Handle<Buffer> handle);
     void destroy(Handle<Buffer> handle);
     bool isLoaded(Handle<Buffer> handle);
+    void waitUntilLoaded(Handle<Buffer> handle);
     void startLoading(Handle<Buffer> handle);
     void finishLoading(Handle<Buffer> handle, Buffer &&asset);
     Handle<Buffer> getNewBufferHandle();
@@ -60,6 +65,11 @@ bool Handle<T>::isLoaded() const {
     return AssetManager::isLoaded(*this);
 }
 
+template<typename T>
+void Handle<T>::waitUntilLoaded() const {
+    AssetManager::waitUntilLoaded(*this);
+}
+
 template<typename T>
 T *Handle<T>::get() const {
     return AssetManager::get(*this);
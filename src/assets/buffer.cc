@@ -4,8 +4,10 @@
 #include <vk_mem_alloc.h>
 
 #include "gfx/engine.h"
+#include "std/memtrack.h"
 
 Handle<Buffer> Buffer::make(usize size, VkBufferUsageFlags usage, VmaMemoryUsage memory_usage) {
+    memtrack::TagScope mem_tag(MemTag::Assets);
     Handle<Buffer> handle = AssetManager::getNewBufferHandle();
 
     Buffer out;
@@ -16,10 +18,12 @@ Handle<Buffer> Buffer::make(usize size, VkBufferUsageFlags usage, VmaMemoryUsage
 }
 
 Handle<Buffer> Buffer::makeAsync() {
+	memtrack::TagScope mem_tag(MemTag::Assets);
 	return AssetManager::getNewBufferHandle();
 }
 
 void Buffer::allocate(usize size, VkBufferUsageFlags usage, VmaMemoryUsage memory_usage) {
+	memtrack::TagScope mem_tag(MemTag::Assets);
 	VkBufferCreateInfo buf_info = {
 		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
 		.size = size,
@@ -2,10 +2,12 @@
 
 #include "gfx/engine.h"
 #include "gfx/descriptor_cache.h"
+#include "std/memtrack.h"
 
 #include "texture.h"
 
 Handle<Descriptor> Descriptor::make(AsyncDescBuilder &builder) {
+    memtrack::TagScope mem_tag(MemTag::Assets);
     Handle<Descriptor> handle = AssetManager::getNewDescriptorHandle();
 
     g_engine->jobpool.pushJob(
@@ -18,9 +20,7 @@ Handle<Descriptor> Descriptor::make(AsyncDescBuilder &builder) {
                 switch (bind.bind_type) {
                     case Type::Error:   err("unkown bind type"); break;
                     case Type::Texture: 
-                        while (!AssetManager::isLoaded(bind.texture)) {
-                            co::yield();
-                        }
+                        bind.texture.waitUntilLoaded();
                         break;
                     case Type::Buffer:  err("buffer not supported yet"); break;
                 }
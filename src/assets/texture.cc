@@ -8,6 +8,7 @@
 #include "std/file.h"
 #include "std/asio.h"
 #include "std/arr.h"
+#include "std/memtrack.h"
 #include "gfx/engine.h"
 
 #include "asset_manager.h"
@@ -173,6 +174,7 @@ static vkptr<VkImageView> texture__make_view(VkImage texture) {
 }
 
 Handle<Texture> Texture::load(StrView filename) {
+    memtrack::TagScope mem_tag(MemTag::Assets);
     Handle<Texture> handle = AssetManager::getNewTextureHandle();
     Str fname = filename;
     
@@ -217,7 +219,8 @@ Handle<Texture> Texture::load(StrView filename) {
 	        texture.view = texture__make_view(texture.image);
 
             AssetManager::finishLoading(handle, mem::move(texture));
-        }
+        },
+        ThreadPool::Background
     );
 
     return handle;
@@ -1,14 +1,72 @@
 #include "coroutine.h"
 
 #include "std/mem.h"
+#include "std/arena.h"
 
 #include "minicoro.h"
 
 namespace co {
     using mco_func = void(mco_coro*);
 
-    Coro::Coro(Func func, void *userdata) {
-        init(func, userdata);
+    static constexpr usize co__stack_sizes[StackSizeCount] = {
+        kb(32), // minimum stack size allowed by minicoro
+        kb(56), // minicoro's default
+        kb(256),
+    };
+
+    // how many free stacks each thread keeps around, anything more is freed
+    static constexpr uint co__max_cached[StackSizeCount] = { 64, 64, 16 };
+
+    struct co__free_stack {
+        co__free_stack *next;
+    };
+
+    // only ever touched by its own thread, so no locking needed. coroutines can
+    // be destroyed on a different thread than the one that created them, the
+    // memory simply moves to the destroying thread's cache
+    struct co__stack_cache {
+        ~co__stack_cache() {
+            for (uint i = 0; i < StackSizeCount; ++i) {
+                while (co__free_stack *stack = heads[i]) {
+                    heads[i] = stack->next;
+                    pk_free(stack);
+                }
+            }
+        }
+
+        co__free_stack *heads[StackSizeCount] = {};
+        uint count[StackSizeCount] = {};
+    };
+
+    static thread_local co__stack_cache co__cache;
+
+    // the size class is passed as allocator_data. minicoro always asks for the same
+    // size for the same class, and clears the coroutine struct itself
+    static void *co__alloc_stack(size_t size, void *allocator_data) {
+        uint size_class = (uint)(uptr)allocator_data;
+        if (co__free_stack *stack = co__cache.heads[size_class]) {
+            co__cache.heads[size_class] = stack->next;
+            --co__cache.count[size_class];
+            return stack;
+        }
+        return pk_malloc(size);
+    }
+
+    static void co__dealloc_stack(void *ptr, size_t size, void *allocator_data) {
+        pk_unused(size);
+        uint size_class = (uint)(uptr)allocator_data;
+        if (co__cache.count[size_class] >= co__max_cached[size_class]) {
+            pk_free(ptr);
+            return;
+        }
+        co__free_stack *stack = (co__free_stack *)ptr;
+        stack->next = co__cache.heads[size_class];
+        co__cache.heads[size_class] = stack;
+        ++co__cache.count[size_class];
+    }
+
+    Coro::Coro(Func func, void *userdata, StackSize stack) {
+        init(func, userdata, stack);
     }
 
     Coro::Coro(Coro &&other) {
@@ -19,9 +77,12 @@ namespace co {
         destroy();
     }
 
-    Result Coro::init(Func func, void *userdata) {
-        mco_desc desc = mco_desc_init((mco_func *)func, 0);
+    Result Coro::init(Func func, void *userdata, StackSize stack) {
+        mco_desc desc = mco_desc_init((mco_func *)func, co__stack_sizes[stack]);
         desc.user_data = userdata;
+        desc.alloc_cb = co__alloc_stack;
+        desc.dealloc_cb = co__dealloc_stack;
+        desc.allocator_data = (void *)(uptr)stack;
         return (Result)mco_create((mco_coro **)&internal, &desc);
     }
 
@@ -39,6 +100,10 @@ namespace co {
     }
 
     Result Coro::yield() {
+#if PK_DEBUG
+        // the scratch arenas belong to the thread, we might resume on another one
+        pk_assert(ScratchScope::openCount() == 0);
+#endif
         return (Result)mco_yield((mco_coro *)internal);
     }
 
@@ -65,6 +130,10 @@ namespace co {
     }
 
     Result yield() {
+#if PK_DEBUG
+        // the scratch arenas belong to the thread, we might resume on another one
+        pk_assert(ScratchScope::openCount() == 0);
+#endif
         return (Result)mco_yield(mco_running());
     }
 
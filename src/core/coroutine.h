@@ -28,13 +28,21 @@ namespace co {
         StackOverflow,
     };
 
+    // stacks are recycled in a per-thread cache for each size
+    enum StackSize {
+        SmallStack,   // 32KB
+        DefaultStack, // 56KB
+        LargeStack,   // 256KB
+        StackSizeCount,
+    };
+
     struct Coro {
         Coro() = default;
-        Coro(Func func, void *userdata = nullptr);
+        Coro(Func func, void *userdata = nullptr, StackSize stack = DefaultStack);
         Coro(Coro &&other);
         ~Coro();
 
-        Result init(Func func, void *userdata = nullptr);
+        Result init(Func func, void *userdata = nullptr, StackSize stack = DefaultStack);
         Result destroy();
 
         Result resume();
@@ -1,86 +1,255 @@
 #include "thread_pool.h"
 
 #include "std/logging.h"
+#include "std/memtrack.h"
 
-#include <windows.h>
+#include <chrono>
+#include <stdio.h>
+#include <tracy/Tracy.hpp>
+
+static u64 pool__now_ns() {
+    using namespace std::chrono;
+    return (u64)duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+thread_local ThreadPool::Worker *ThreadPool::tls_worker = nullptr;
 
 void ThreadPool::start(uint initial_thread_count) {
-    stop_handle = CreateEvent(
-        nullptr,
-        TRUE,               // manual-reset event
-        FALSE,              // initial state is nonsignaled
-        nullptr
-    );
-    
-    for (uint i = 0; i < initial_thread_count; ++i) {
-        pushThread();
+    // the first pushJob starts the pool, so two threads can get here at once
+    queue_mtx.lock();
+    if (worker_count > 0) {
+        queue_mtx.unlock();
+        return;
     }
+
+    should_stop = false;
+
+    uint core_count = Thread::getCoreCount();
+    if (max_workers == 0) {
+        max_workers = core_count;
+    }
+    max_workers = math::min(max_workers, kmax_workers);
+
+    if (initial_thread_count == 0) {
+        initial_thread_count = core_count > 1 ? core_count - 1 : 1;
+    }
+    base_workers = math::clamp(initial_thread_count, 1u, max_workers);
+
+    for (uint i = 0; i < base_workers; ++i) {
+        spawnWorker();
+    }
+
+    queue_mtx.unlock();
 }
 
 bool ThreadPool::isBusy() {
-    for (Queue *queue : thread_queues) {
-        if (queue->getJobCount() > 0) {
-            return true;
-        }
-    }
-    return false;
+    return job_count > 0;
 }
 
 void ThreadPool::stop() {
     should_stop = true;
-    SetEvent((HANDLE)stop_handle);
-    Thread::joinAll(threads);
-    ResetEvent((HANDLE)stop_handle);
-    thread_queues.clear();
-    threads.clear();
+    uint count = worker_count;
+    for (uint i = 0; i < count; ++i) {
+        wake(*workers[i]);
+    }
+    // retired workers' threads are still waiting to be joined too
+    for (Thread &thread : threads) {
+        if (thread.isValid()) {
+            thread.join();
+        }
+    }
+    worker_count = 0;
+}
+
+void ThreadPool::pushJob(Job &&job, JobCounter *counter) {
+    pushJob(mem::move(job), JobFlags::None, counter);
+}
+
+void ThreadPool::pushJob(Job &&job, JobFlags flags, JobCounter *counter) {
+    // the job runs with the caller's tag, the pool's own memory is counted as jobs
+    MemTag job_tag = memtrack::getTag();
+    memtrack::TagScope mem_tag(MemTag::Jobs);
+
+    if (worker_count == 0) {
+        start();
+    }
+
+    JobData *job_data = allocJob();
+    if (!job_data) {
+        err("Arena out of memory! can't add the job");
+        return;
+    }
+
+    auto coroutine__function = []() {
+        JobData *data = (JobData *)co::getUserData();
+        data->job();
+    };
+
+    job_data->job = mem::move(job);
+
+    // jobs that never yield don't need a coroutine, runJob calls them directly
+    if (!(flags & JobFlags::NoYield)) {
+        co::StackSize stack = co::DefaultStack;
+        if (flags & JobFlags::SmallStack)      stack = co::SmallStack;
+        else if (flags & JobFlags::LargeStack) stack = co::LargeStack;
+
+        job_data->coroutine.init(coroutine__function, job_data, stack);
+    }
 
-    CloseHandle((HANDLE)stop_handle);
-    for (void *handle : wait_handles) {
-        CloseHandle((HANDLE)handle);
+    job_data->counter = counter;
+    job_data->pool = this;
+    job_data->yield_count = 0;
+    job_data->mem_tag = job_tag;
+    job_data->lane = NormalLane;
+    if (flags & JobFlags::Critical)        job_data->lane = CriticalLane;
+    else if (flags & JobFlags::Background) job_data->lane = BackgroundLane;
+
+    if (counter) {
+        counter->add();
     }
+
+    ++job_count;
+    schedule(job_data);
 }
 
-void ThreadPool::pushJob(Job &&job) {
-    if (threads.empty()) {
-        pushThread();
+void ThreadPool::schedule(JobData *job_data) {
+    int pending = job_count;
+
+    // pushing from one of our workers, put it in its own queue so that
+    // it stays hot in cache, idle workers will steal it if needed
+    Worker *self = tls_worker;
+    if (self && self->pool == this && self->lanes[job_data->lane].queue.push(job_data)) {
+        self->stats.max(self->stats.queue_high_water, self->lanes[job_data->lane].queue.size());
+        wakeOne();
+        return;
     }
 
-    int min_count = INT_MAX;
-    Queue *smallest = nullptr;
+    uint count = worker_count;
 
-    // try to find a queue with not enough jobs
-    for (Queue *queue : thread_queues) {
-        int count = queue->getJobCount();
-        if (count < min_count) {
-            min_count = count;
-            smallest = queue;
+    // parked jobs can be requeued from a non worker thread after stop(),
+    // bring the workers back like pushJob does
+    if (count == 0) {
+        start();
+        count = worker_count;
+    }
 
-            // no need to wait if we found an empty queue
-            if (count == 0) {
+    // every worker is already busy with a full queue, add a new one
+    if (pending > (int)(count * max_jobs_per_thread) && count < max_workers) {
+        bool all_busy = true;
+        for (uint i = 0; i < count; ++i) {
+            if (workers[i]->is_sleeping) {
+                all_busy = false;
                 break;
             }
         }
+        if (all_busy) {
+            pushThread();
+            count = worker_count;
+        }
     }
 
-    if (min_count >= (int)max_jobs_per_thread) {
-        pushThread();
-        smallest = thread_queues.back();
+    // round robin between the workers, the one we pick will move it to its
+    // queue where any other worker can steal it
+    Worker *target = workers[next_worker++ % count];
+    target->pushInbox(job_data);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    // the worker retired after we picked it, pairs with the fence in tryRetire
+    if (target->is_retired) {
+        handOff(*target);
+    }
+    else if (target->is_sleeping) {
+        wake(*target);
     }
-
-    pk_assert(smallest);
-    smallest->push(mem::move(job));
 }
 
 void ThreadPool::setMaxJobsPerThread(uint max_jobs) {
     max_jobs_per_thread = max_jobs;
 }
 
+void ThreadPool::setMaxThreads(uint max_threads) {
+    max_workers = math::min(max_threads, kmax_workers);
+}
+
+void ThreadPool::setPinToCores(bool pin) {
+    pin_to_cores = pin;
+}
+
+void ThreadPool::setIdleTimeout(uint ms) {
+    idle_timeout_ms = ms;
+}
+
+ThreadPool::WorkerStats ThreadPool::getWorkerStats(uint worker_index) const {
+    if (worker_index >= worker_count) {
+        return {};
+    }
+    return workers[worker_index]->stats.load();
+}
+
+ThreadPool::WorkerStats ThreadPool::getTotalStats() const {
+    WorkerStats total;
+    uint count = worker_count;
+    for (uint i = 0; i < count; ++i) {
+        total += workers[i]->stats.load();
+    }
+    return total;
+}
+
+void ThreadPool::resetStats() {
+    uint count = worker_count;
+    for (uint i = 0; i < count; ++i) {
+        workers[i]->stats.reset();
+        workers[i]->last_plotted = {};
+    }
+}
+
+void ThreadPool::plotStats() {
+    // tracy keeps the pointer to the plot name, so they need to stay around
+    static char plot_names[kmax_workers][3][32];
+    static bool names_init = false;
+    if (!names_init) {
+        for (uint i = 0; i < kmax_workers; ++i) {
+            snprintf(plot_names[i][0], sizeof(plot_names[i][0]), "worker %u jobs", i);
+            snprintf(plot_names[i][1], sizeof(plot_names[i][1]), "worker %u yields", i);
+            snprintf(plot_names[i][2], sizeof(plot_names[i][2]), "worker %u idle ms", i);
+        }
+        names_init = true;
+    }
+
+    WorkerStats total;
+    uint count = worker_count;
+    for (uint i = 0; i < count; ++i) {
+        Worker *worker = workers[i];
+        WorkerStats stats = worker->stats.load();
+        WorkerStats &last = worker->last_plotted;
+
+        TracyPlot(plot_names[i][0], (int64_t)(stats.jobs_executed - last.jobs_executed));
+        TracyPlot(plot_names[i][1], (int64_t)(stats.yields - last.yields));
+        TracyPlot(plot_names[i][2], (double)(stats.idle_time_ns - last.idle_time_ns) / 1000000.0);
+
+        total += stats;
+        last = stats;
+    }
+
+    TracyPlot("pool workers", (int64_t)count);
+    TracyPlot("pool pending jobs", (int64_t)job_count.load());
+    TracyPlot("pool steals", (int64_t)total.steals);
+    TracyPlot("pool wakeups", (int64_t)total.wakeups);
+    TracyPlot("pool queue high water", (int64_t)total.queue_high_water);
+    TracyPlot("pool avg job ms", total.avgRunTimeMs());
+}
+
 usize ThreadPool::getNumOfThreads() const {
-    return threads.len;
+    return worker_count;
 }
 
 usize ThreadPool::getThreadIndex(uptr thread_id) const {
-    for (usize i = 0; i < threads.len; ++i) {
+    // a new worker can start running jobs before it is published
+    if (Worker *self = tls_worker; self && self->pool == this && thread_id == Thread::currentId()) {
+        return self->index;
+    }
+
+    uint count = worker_count;
+    for (usize i = 0; i < count; ++i) {
         if (threads[i].getId() == thread_id) {
             return i;
         }
@@ -89,243 +258,767 @@ usize ThreadPool::getThreadIndex(uptr thread_id) const {
     return SIZE_MAX;
 }
 
-const arr<Thread> &ThreadPool::getThreads() const {
-    return threads;
+Slice<Thread> ThreadPool::getThreads() const {
+    return Slice<Thread>(threads, worker_count);
 }
 
-void ThreadPool::threadLoop() {
-    Job job;
+void ThreadPool::threadLoop(Worker &worker) {
+    tls_worker = &worker;
 
-    while (true) {
-        stop_mtx.lock();
-        bool is_stopping = should_stop;
-        stop_mtx.unlock();
-        if (is_stopping) return;
-
-        Queue *queue = getQueue();
-        if (!queue) {
+    while (!should_stop) {
+        JobData *job_data = findJob(worker);
+        if (!job_data) {
+            if (!park(worker)) {
+                break;
+            }
             continue;
         }
-        JobData *job_data = queue->pop();
-        // if quitting
-        if (!job_data) {
-            break;
+        runJob(worker, job_data);
+    }
+
+    tls_worker = nullptr;
+}
+
+void ThreadPool::pushThread() {
+    queue_mtx.lock();
+    spawnWorker();
+    queue_mtx.unlock();
+}
+
+void ThreadPool::spawnWorker() {
+    memtrack::TagScope mem_tag(MemTag::Jobs);
+
+    uint index = worker_count;
+    if (index >= math::max(max_workers, 1u)) {
+        return;
+    }
+
+    // if a worker retired from this slot its thread is exiting or already gone,
+    // it has to be done with the worker before we give it to a new one
+    Thread &thread = threads[index];
+    thread.join();
+
+    // reuse the worker if one retired from this slot, its queues are already empty
+    Worker *worker = workers[index];
+    if (!worker) {
+        worker = queue_arena.alloc<Worker>();
+        worker->init(this, index);
+        workers[index] = worker;
+    }
+    worker->is_retired = false;
+
+    thread = Thread::create(
+        [](void *udata) {
+            Worker *worker = (Worker *)udata;
+            worker->pool->threadLoop(*worker);
+            return 0;
+        },
+        worker
+    );
+
+    if (pin_to_cores) {
+        // leave the first core to the main thread
+        thread.setAffinity((index + 1) % Thread::getCoreCount());
+    }
+
+    // only publish the worker once it and its thread are stored, they are read without the lock
+    worker_count = index + 1;
+}
+
+ThreadPool::JobData *ThreadPool::allocJob() {
+    return job_pool.alloc();
+}
+
+void ThreadPool::freeJob(JobData *job_data) {
+    // the destructor takes care of the job and its coroutine
+    job_pool.free(job_data);
+}
+
+ThreadPool::JobData *ThreadPool::findJob(Worker &worker) {
+    // a lane is only looked at once every higher priority lane is empty,
+    // including what we could steal from the other workers
+    for (uint lane = 0; lane < LaneCount; ++lane) {
+        if (JobData *job_data = findJobInLane(worker, (Lane)lane)) {
+            return job_data;
         }
-        job_data->coroutine.resume();
-        co::State result = job_data->coroutine.status();
-        if (result == co::Dead) {
-            queue->finishJob();
+    }
+
+    return nullptr;
+}
+
+ThreadPool::JobData *ThreadPool::findJobInLane(Worker &worker, Lane lane) {
+    WorkerLane &wl = worker.lanes[lane];
+
+    // give yielded jobs a turn every other job, otherwise a steady stream
+    // of new jobs would starve them
+    if (wl.run_yielded) {
+        wl.run_yielded = false;
+        if (JobData *job_data = worker.popYielded(lane)) {
+            return job_data;
         }
-        else {
-            queue->yieldJob();
+    }
+    wl.run_yielded = true;
+
+    if (JobData *job_data = wl.queue.pop()) {
+        return job_data;
+    }
+
+    // move everything that was pushed from outside into our queue, so
+    // other workers can steal it
+    if (!wl.inbox.isEmpty() && worker.lockInbox(lane)) {
+        // stop once the queue is full, the rest stays in the inbox for later
+        while (wl.queue.size() < WorkQueue::kcapacity) {
+            JobData *job_data = worker.popInbox(lane);
+            if (!job_data) break;
+            wl.queue.push(job_data);
         }
+        worker.unlockInbox(lane);
+
+        worker.stats.max(worker.stats.queue_high_water, wl.queue.size());
+
+        // if we got more than one job, let another worker steal the rest
+        if (wl.queue.size() > 1) {
+            wakeOne();
+        }
+
+        if (JobData *job_data = wl.queue.pop()) {
+            return job_data;
+        }
+    }
+
+    if (JobData *job_data = stealJob(&worker, lane)) {
+        worker.stats.add(worker.stats.steals, 1);
+        return job_data;
     }
+
+    return worker.popYielded(lane);
 }
 
-void ThreadPool::pushThread() {
-    HANDLE wait_handle = CreateEvent(
-        nullptr,
-        TRUE,               // manual-reset event
-        FALSE,              // initial state is nonsignaled
-        nullptr
-    );
-    wait_handles.push(wait_handle);
+ThreadPool::JobData *ThreadPool::stealJob(Worker *thief, Lane lane) {
+    uint count = worker_count;
+    if (count == 0 || (thief && count <= 1)) return nullptr;
 
-    Queue *queue = queue_arena.alloc<Queue>();
-    queue->init(wait_handle, stop_handle);
+    // start from a different worker every time so we don't all hammer the first one
+    uint start = thief ? thief->index + 1 : next_worker.load();
+    for (uint i = 0; i < count; ++i) {
+        Worker *victim = workers[(start + i) % count];
+        if (victim == thief) continue;
+        if (JobData *job_data = victim->lanes[lane].queue.steal()) {
+            return job_data;
+        }
+    }
 
+    return nullptr;
+}
+
+void ThreadPool::runJob(Worker &worker, JobData *job_data) {
+    // runJob can be called recursively from helpOne
+    Lane prev_lane = worker.current_lane;
+    worker.current_lane = job_data->lane;
+    u64 start_time = pool__now_ns();
+    MemTag prev_tag = memtrack::setTag(job_data->mem_tag);
+
+    if (!job_data->coroutine.internal) {
+        job_data->job();
+        memtrack::setTag(prev_tag);
+        worker.current_lane = prev_lane;
+        worker.stats.add(worker.stats.run_time_ns, pool__now_ns() - start_time);
+        worker.stats.add(worker.stats.jobs_executed, 1);
+        finishJob(job_data);
+        return;
+    }
+
+    job_data->coroutine.resume();
+    // keeps whatever scope the job was in if it yielded
+    job_data->mem_tag = memtrack::setTag(prev_tag);
+    worker.current_lane = prev_lane;
+    worker.stats.add(worker.stats.run_time_ns, pool__now_ns() - start_time);
+
+    co::State result = job_data->coroutine.status();
+    if (result == co::Dead) {
+        worker.stats.add(worker.stats.jobs_executed, 1);
+        worker.stats.max(worker.stats.max_job_yields, job_data->yield_count);
+        finishJob(job_data);
+        return;
+    }
+
+    ++job_data->yield_count;
+    worker.stats.add(worker.stats.yields, 1);
+
+    if (JobEvent *event = worker.wait_event) {
+        worker.wait_event = nullptr;
+        // the event might have been signalled while we were yielding
+        if (!parkJob(*event, job_data)) {
+            worker.pushYielded(job_data);
+        }
+    }
+    else {
+        // job is yielded but not finished, put it at the end of the line
+        worker.pushYielded(job_data);
+    }
+}
+
+bool ThreadPool::park(Worker &worker) {
+    // read the signal before checking for work, if anyone wakes us after
+    // this point the value will have changed and futex::wait returns immediately
+    u32 signal = worker.wake_signal.load();
+    worker.is_sleeping = true;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    // something might have been pushed before we set the flag,
+    // check again before actually going to sleep
+    if (hasWork(worker)) {
+        worker.is_sleeping = false;
+        return true;
+    }
+
+    bool is_extra = worker.index >= base_workers;
+    u64 idle_start = pool__now_ns();
+    bool woken = futex::wait(worker.wake_signal, signal, is_extra ? idle_timeout_ms : UINT_MAX);
+    worker.stats.add(worker.stats.idle_time_ns, pool__now_ns() - idle_start);
+
+    worker.is_sleeping = false;
+
+    if (!woken && is_extra) {
+        return !tryRetire(worker);
+    }
+
+    return true;
+}
+
+bool ThreadPool::tryRetire(Worker &worker) {
     queue_mtx.lock();
-    thread_queues.push(queue);
+
+    // only the last worker can retire, this way the active workers are always [0, worker_count)
+    if (should_stop || worker.index + 1 != worker_count || hasWork(worker)) {
+        queue_mtx.unlock();
+        return false;
+    }
+
+    worker.is_retired = true;
+    worker_count = worker.index;
+
     queue_mtx.unlock();
 
-    threads.push(
-        Thread::create(
-            [](void *udata) {
-                ThreadPool *self = (ThreadPool *)udata;
-                self->threadLoop();
-                return 0;
-            },
-            this
-        )
-    );
+    // anything pushed before the pusher could see we retired is given to another worker
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    handOff(worker);
+
+    return true;
 }
 
-ThreadPool::Queue *ThreadPool::getQueue() {
-    uptr id = Thread::currentId();
+void ThreadPool::handOff(Worker &retired) {
+    // the first worker never retires
+    Worker *target = workers[0];
 
-    Queue *queue = nullptr;
+    bool moved = false;
+    for (uint lane = 0; lane < LaneCount; ++lane) {
+        // the retired worker and the pusher that noticed it can both get here
+        while (!retired.lockInbox((Lane)lane)) {
+            Thread::pause();
+        }
 
-    queue_mtx.lock();
-    for (usize i = 0; i < threads.len; ++i) {
-        if (threads[i].getId() == id) {
-            queue = thread_queues[i];
-            break;
+        // keep going until it's really empty, a pop can fail while a push is halfway through
+        while (!retired.lanes[lane].inbox.isEmpty()) {
+            if (JobData *job_data = retired.popInbox((Lane)lane)) {
+                target->pushInbox(job_data);
+                moved = true;
+            }
         }
+
+        retired.unlockInbox((Lane)lane);
     }
-    queue_mtx.unlock();
 
-    return queue;
+    if (moved) {
+        wake(*target);
+    }
 }
 
-void ThreadPool::Queue::init(void *in_wait_handle, void *in_stop_handle) {
-    arena = Arena::make(gb(1), Arena::Virtual);
-    head_mtx.init();
-    tail_mtx.init();
-    free_mtx.init();
-    count_mtx.init();
-    arena_mtx.init();
+void ThreadPool::wakeOne() {
+    // pairs with the fence in park, either we see the worker sleeping or it sees our job
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint count = worker_count;
+    for (uint i = 0; i < count; ++i) {
+        Worker *worker = workers[i];
+        if (worker->is_sleeping) {
+            wake(*worker);
+            return;
+        }
+    }
+}
 
-    wait_handle = in_wait_handle;
-    stop_handle = in_stop_handle;
+void ThreadPool::wake(Worker &worker) {
+    worker.stats.add(worker.stats.wakeups, 1);
+    worker.wake_signal.fetch_add(1);
+    futex::wakeOne(worker.wake_signal);
 }
 
-ThreadPool::JobData *ThreadPool::Queue::pop() {
-    head_mtx.lock();
+bool ThreadPool::hasWork(Worker &worker) {
+    if (should_stop) {
+        return true;
+    }
 
-    while (!head) {
-        head_mtx.unlock();
-        Slice<HANDLE> handles = { stop_handle, wait_handle };
-        DWORD result = WaitForMultipleObjects((DWORD)handles.len, handles.buf, FALSE, INFINITE);
-        if (result == WAIT_OBJECT_0) {
-            return nullptr;
+    for (WorkerLane &wl : worker.lanes) {
+        if (wl.yield_head || wl.queue.size() > 0) {
+            return true;
+        }
+
+        if (!wl.inbox.isEmpty()) {
+            return true;
         }
-        head_mtx.lock();
     }
 
-    ResetEvent((HANDLE)wait_handle);
+    uint count = worker_count;
+    for (uint i = 0; i < count; ++i) {
+        for (WorkerLane &wl : workers[i]->lanes) {
+            if (wl.queue.size() > 0) {
+                return true;
+            }
+        }
+    }
 
-    pk_assert(head);
+    return false;
+}
 
-    JobData *job_data = &head->job_data;
-    head_mtx.unlock();
+void ThreadPool::parallelForImpl(usize begin, usize end, usize grain, RangeFn *fn, void *udata) {
+    if (end <= begin) {
+        return;
+    }
 
-    return job_data;
+    if (worker_count == 0) {
+        start();
+    }
+
+    if (grain == 0) {
+        // a few chunks per worker, so that there is something left to steal
+        // if some chunks are slower than others
+        grain = math::max<usize>((end - begin) / (worker_count * 4 + 4), 1);
+    }
+
+    // the pieces get the priority of whoever is waiting on them, a thread
+    // outside of the pool blocks on it so it's treated as critical
+    Lane lane = CriticalLane;
+    if (Worker *self = tls_worker; self && self->pool == this) {
+        lane = self->current_lane;
+    }
+
+    JobFlags flags = JobFlags::Critical;
+    if (lane == NormalLane)          flags = JobFlags::None;
+    else if (lane == BackgroundLane) flags = JobFlags::Background;
+
+    JobCounter counter;
+    // count our own part too, so the counter can't reach zero while we're still splitting
+    counter.add();
+    runRange({ begin, end, grain, fn, udata, &counter, flags });
+    counter.done();
+
+    // help with whatever is left instead of blocking
+    while (!counter.isDone() && helpOne(lane)) {
+    }
+
+    counter.wait();
+}
+
+void ThreadPool::runRange(ParallelRange range) {
+    // keep giving away the top half until what's left is small enough
+    while (range.end - range.begin > range.grain) {
+        usize mid = range.begin + (range.end - range.begin) / 2;
+        ParallelRange upper = range;
+        upper.begin = mid;
+        // the counter is incremented before the job is pushed, while we still hold our part
+        pushJob([this, upper]() { runRange(upper); }, (JobFlags)(upper.flags | JobFlags::NoYield), upper.counter);
+        range.end = mid;
+    }
+
+    range.fn(range.udata, range.begin, range.end);
 }
 
-void ThreadPool::Queue::push(Job &&fn) {
-    Node *node = nullptr;
+bool ThreadPool::helpOne(Lane max_lane) {
+    Worker *self = tls_worker;
+    if (self && self->pool != this) {
+        self = nullptr;
+    }
 
-    // try grabbing a free node
-    if (free_mtx.tryLock()) {
-        if (freelist) {
-            node = freelist;
-            freelist = freelist->next;
+    // a lower priority job could take much longer than what we're waiting on
+    JobData *job_data = nullptr;
+    for (uint lane = 0; lane <= max_lane && !job_data; ++lane) {
+        if (self) {
+            job_data = self->lanes[lane].queue.pop();
         }
-        free_mtx.unlock();
+        if (!job_data) {
+            job_data = stealJob(self, (Lane)lane);
+            if (job_data && self) {
+                self->stats.add(self->stats.steals, 1);
+            }
+        }
+    }
+    if (!job_data) {
+        return false;
     }
 
-    // if there are no free nodes, or if the freelist is busy, make a new one
-    if (!node) {
-        arena_mtx.lock();
-        node = arena.alloc<Node>(1, Arena::SoftFail);
-        arena_mtx.unlock();
-        if (!node) {
-            err("Arena out of memory! can't add the job");
-            return;
+    if (self) {
+        runJob(*self, job_data);
+        return true;
+    }
+
+    // not one of our workers. a job that can yield might end up waiting on this
+    // thread (e.g. a load waiting on the main thread to submit the transfers), and
+    // JobEvent::wait can only block here, so give it back and stop helping
+    if (job_data->coroutine.internal) {
+        schedule(job_data);
+        return false;
+    }
+
+    MemTag prev_tag = memtrack::setTag(job_data->mem_tag);
+    job_data->job();
+    memtrack::setTag(prev_tag);
+    finishJob(job_data);
+
+    return true;
+}
+
+void ThreadPool::finishJob(JobData *job_data) {
+    JobCounter *counter = job_data->counter;
+    freeJob(job_data);
+    --job_count;
+    if (counter) {
+        counter->done();
+    }
+}
+
+bool ThreadPool::parkJob(JobEvent &event, JobData *job_data) {
+    uptr head = event.state.load();
+    do {
+        if (head == JobEvent::kset) {
+            return false;
         }
+        job_data->next = (JobData *)head;
+    } while (!event.state.compare_exchange_weak(head, (uptr)job_data));
+
+    return true;
+}
+
+// == WORKER ==============================================================================================
+
+void ThreadPool::Worker::init(ThreadPool *owner, uint worker_index) {
+    for (WorkerLane &wl : lanes) {
+        wl.inbox.init();
+        wl.inbox_draining = false;
+        wl.queue.top = 0;
+        wl.queue.bottom = 0;
     }
+    pool = owner;
+    index = worker_index;
+    current_lane = NormalLane;
+    is_sleeping = false;
+    is_retired = false;
+    wake_signal = 0;
+}
 
-    pk_assert(node);
+void ThreadPool::Worker::pushInbox(JobData *job_data) {
+    lanes[job_data->lane].inbox.push(job_data);
+}
 
-    auto coroutine__function = []() {
-        Node *node = (Node *)co::getUserData();
-        node->job_data.job();
-    };
+bool ThreadPool::Worker::lockInbox(Lane lane) {
+    return !lanes[lane].inbox_draining.exchange(true, std::memory_order_acquire);
+}
 
-    node->job_data.job = mem::move(fn);
-    node->job_data.coroutine.init(coroutine__function, node);
+void ThreadPool::Worker::unlockInbox(Lane lane) {
+    lanes[lane].inbox_draining.store(false, std::memory_order_release);
+}
 
-    // append to the end
-    tail_mtx.lock();
-    if (tail) {
-        tail->next = node;
-        tail = node;
+ThreadPool::JobData *ThreadPool::Worker::popInbox(Lane lane) {
+    return (JobData *)lanes[lane].inbox.pop();
+}
+
+void ThreadPool::Worker::pushYielded(JobData *job_data) {
+    WorkerLane &wl = lanes[job_data->lane];
+    job_data->next = nullptr;
+    if (wl.yield_tail) {
+        wl.yield_tail->next = job_data;
+        wl.yield_tail = job_data;
     }
-    // if there are no nodes, make this the head too
     else {
-        head_mtx.lock();
-        head = tail = node;
-        head_mtx.unlock();
+        wl.yield_head = wl.yield_tail = job_data;
     }
-    tail_mtx.unlock();
+}
 
-    // add count
-    count_mtx.lock();
-    job_count++;
-    if (job_count == 1) {
-        SetEvent((HANDLE)wait_handle);
+ThreadPool::JobData *ThreadPool::Worker::popYielded(Lane lane) {
+    WorkerLane &wl = lanes[lane];
+    JobData *job_data = wl.yield_head;
+    if (job_data) {
+        wl.yield_head = job_data->next;
+        if (!wl.yield_head) wl.yield_tail = nullptr;
+        job_data->next = nullptr;
     }
-    count_mtx.unlock();
+    return job_data;
 }
 
-void ThreadPool::Queue::yieldJob() {
-    tail_mtx.lock();
-    head_mtx.lock();
+// == STATS ===============================================================================================
 
-    pk_assert(head && tail);
+double ThreadPool::WorkerStats::avgRunTimeMs() const {
+    if (jobs_executed == 0) return 0.0;
+    return (double)run_time_ns / (double)jobs_executed / 1000000.0;
+}
 
-    // job is yielded but not finished, but at the end of the queue
+ThreadPool::WorkerStats &ThreadPool::WorkerStats::operator+=(const WorkerStats &other) {
+    jobs_executed   += other.jobs_executed;
+    yields          += other.yields;
+    steals          += other.steals;
+    wakeups         += other.wakeups;
+    run_time_ns     += other.run_time_ns;
+    idle_time_ns    += other.idle_time_ns;
+    max_job_yields   = math::max(max_job_yields, other.max_job_yields);
+    queue_high_water = math::max(queue_high_water, other.queue_high_water);
+    return *this;
+}
 
-    // append to the end
-    if (head != tail) {
-        tail->next = head;
-        tail = head;
+void ThreadPool::AtomicStats::add(std::atomic<u64> &stat, u64 value) {
+    stat.fetch_add(value, std::memory_order_relaxed);
+}
 
-        head = head->next;
+void ThreadPool::AtomicStats::max(std::atomic<u64> &stat, u64 value) {
+    // only the owner raises the maximums, so no need for a compare exchange
+    if (value > stat.load(std::memory_order_relaxed)) {
+        stat.store(value, std::memory_order_relaxed);
     }
+}
 
-    head_mtx.unlock();
-    tail_mtx.unlock();
+ThreadPool::WorkerStats ThreadPool::AtomicStats::load() const {
+    WorkerStats out;
+    out.jobs_executed    = jobs_executed.load(std::memory_order_relaxed);
+    out.yields           = yields.load(std::memory_order_relaxed);
+    out.steals           = steals.load(std::memory_order_relaxed);
+    out.wakeups          = wakeups.load(std::memory_order_relaxed);
+    out.run_time_ns      = run_time_ns.load(std::memory_order_relaxed);
+    out.idle_time_ns     = idle_time_ns.load(std::memory_order_relaxed);
+    out.max_job_yields   = max_job_yields.load(std::memory_order_relaxed);
+    out.queue_high_water = queue_high_water.load(std::memory_order_relaxed);
+    return out;
 }
 
-void ThreadPool::Queue::finishJob() {
-    pk_assert(head);
+void ThreadPool::AtomicStats::reset() {
+    jobs_executed    = 0;
+    yields           = 0;
+    steals           = 0;
+    wakeups          = 0;
+    run_time_ns      = 0;
+    idle_time_ns     = 0;
+    max_job_yields   = 0;
+    queue_high_water = 0;
+}
 
-    // remove count
-    count_mtx.lock();
-    job_count--;
-    count_mtx.unlock();
+// == JOB EVENT ===========================================================================================
 
-    // TODO: use arena allocator for these too
-    head->job_data.job.destroy();
-    head->job_data.coroutine.destroy();
+JobEvent::JobEvent(bool is_set) {
+    state = is_set ? kset : 0;
+}
 
-    head_mtx.lock();
-    tail_mtx.lock();
-    // if head is tail, clear the whole queue and reset the allocator
-    if (head == tail) {
-        // clear queue
-        arena_mtx.lock();
-        arena.rewind(0);
-        arena_mtx.unlock();
+void JobEvent::signal() {
+    ++signalling;
 
-        tail = nullptr;
-        head = nullptr;
+    uptr list = state.exchange(kset);
 
-        head_mtx.unlock();
-        tail_mtx.unlock();
-        return;
+    if (list != kset) {
+        // put all the parked jobs back in the queues
+        ThreadPool::JobData *job_data = (ThreadPool::JobData *)list;
+        while (job_data) {
+            ThreadPool::JobData *next = job_data->next;
+            job_data->next = nullptr;
+            job_data->pool->schedule(job_data);
+            job_data = next;
+        }
+    }
+
+    ++generation;
+    if (thread_waiters > 0) {
+        futex::wakeAll(generation);
+    }
+
+    // has to be the last time we touch the event
+    --signalling;
+}
+
+void JobEvent::reset() {
+    // only reset if it is set, otherwise we would lose the parked jobs
+    uptr expected = kset;
+    state.compare_exchange_strong(expected, 0);
+}
+
+bool JobEvent::isSet() const {
+    return state.load() == kset;
+}
+
+void JobEvent::wait() {
+#if PK_DEBUG
+    // see Arena::scratch, whatever runs while we wait can reuse the scratch arenas
+    pk_assert(ScratchScope::openCount() == 0);
+#endif
+
+    while (!isSet()) {
+        ThreadPool::Worker *worker = ThreadPool::tls_worker;
+        if (worker && co::getUserData()) {
+            // runJob will park us once we're out of the coroutine
+            worker->wait_event = this;
+            co::yield();
+            continue;
+        }
+
+        u32 gen = generation;
+        ++thread_waiters;
+        if (!isSet()) {
+            futex::wait(generation, gen);
+        }
+        --thread_waiters;
+    }
+
+    // the event might go out of scope as soon as we return
+    while (signalling > 0) {
+        Thread::pause();
     }
-    tail_mtx.unlock();
+}
+
+// == JOB COUNTER =========================================================================================
 
-    // otherwise, pop the head and put it in the freelist
+void JobCounter::add(int n) {
+    if (value.fetch_add(n) == 0) {
+        // the done that brought us to zero might not have signalled yet, resetting
+        // before it does would leave the event set while we still have work
+        while (!event.isSet()) {
+            Thread::pause();
+        }
+        event.reset();
+    }
+}
 
-    // pop head
-    Node *old_head = head;
-    head = head->next;
-    // we don't need the head anymore
-    head_mtx.unlock();
+void JobCounter::done(int n) {
+    if (value.fetch_sub(n) == n) {
+        event.signal();
+    }
+}
+
+bool JobCounter::isDone() const {
+    return event.isSet();
+}
+
+void JobCounter::wait() {
+    event.wait();
+}
+
+// == MPSC QUEUE ==========================================================================================
+
+void ThreadPool::MpscQueue::init() {
+    stub.link = nullptr;
+    head = &stub;
+    tail = &stub;
+}
+
+void ThreadPool::MpscQueue::push(MpscNode *node) {
+    node->link.store(nullptr, std::memory_order_relaxed);
+    MpscNode *prev = head.exchange(node, std::memory_order_acq_rel);
+    // between the exchange and this store the queue is briefly "broken", pop will return null
+    prev->link.store(node, std::memory_order_release);
+}
 
-    // save old head in freelist
-    free_mtx.lock();
-    old_head->next = freelist;
-    freelist = old_head;
-    free_mtx.unlock();
+ThreadPool::MpscNode *ThreadPool::MpscQueue::pop() {
+    MpscNode *cur = tail.load(std::memory_order_relaxed);
+    MpscNode *next = cur->link.load(std::memory_order_acquire);
+
+    // skip the stub
+    if (cur == &stub) {
+        if (!next) {
+            return nullptr;
+        }
+        tail.store(next, std::memory_order_relaxed);
+        cur = next;
+        next = next->link.load(std::memory_order_acquire);
+    }
+
+    if (next) {
+        tail.store(next, std::memory_order_relaxed);
+        return cur;
+    }
+
+    // a producer is in the middle of a push
+    if (cur != head.load(std::memory_order_acquire)) {
+        return nullptr;
+    }
+
+    // cur is the last node, put the stub back behind it so we can take it
+    push(&stub);
+
+    next = cur->link.load(std::memory_order_acquire);
+    if (next) {
+        tail.store(next, std::memory_order_relaxed);
+        return cur;
+    }
+
+    return nullptr;
+}
+
+bool ThreadPool::MpscQueue::isEmpty() const {
+    return tail.load(std::memory_order_relaxed) == &stub && head.load(std::memory_order_acquire) == &stub;
+}
+
+// == WORK QUEUE ==========================================================================================
+
+bool ThreadPool::WorkQueue::push(JobData *job_data) {
+    isize b = bottom.load(std::memory_order_relaxed);
+    isize t = top.load(std::memory_order_acquire);
+    if (b - t >= kcapacity) {
+        return false;
+    }
+
+    buffer[b & kmask].store(job_data, std::memory_order_relaxed);
+    bottom.store(b + 1, std::memory_order_release);
+    return true;
+}
+
+ThreadPool::JobData *ThreadPool::WorkQueue::pop() {
+    isize b = bottom.load(std::memory_order_relaxed) - 1;
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    isize t = top.load(std::memory_order_relaxed);
+
+    // queue was empty
+    if (t > b) {
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    JobData *job_data = buffer[b & kmask].load(std::memory_order_relaxed);
+
+    // last item, race against the thieves for it
+    if (t == b) {
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            job_data = nullptr;
+        }
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    return job_data;
+}
+
+ThreadPool::JobData *ThreadPool::WorkQueue::steal() {
+    isize t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    isize b = bottom.load(std::memory_order_acquire);
+
+    if (t >= b) {
+        return nullptr;
+    }
+
+    JobData *job_data = buffer[t & kmask].load(std::memory_order_relaxed);
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+        // lost the race against the owner or another thief
+        return nullptr;
+    }
+
+    return job_data;
 }
 
-int ThreadPool::Queue::getJobCount() {
-    count_mtx.lock();
-    int count = job_count;
-    count_mtx.unlock();
-    return count;
+isize ThreadPool::WorkQueue::size() const {
+    isize b = bottom.load(std::memory_order_relaxed);
+    isize t = top.load(std::memory_order_relaxed);
+    return b > t ? b - t : 0;
 }
@@ -1,78 +1,358 @@
 #pragma once
 
 // #include <functional>
-// #include <atomic>
+#include <atomic>
+#include <type_traits>
 
 #include "std/threads.h"
 #include "std/arena.h"
+#include "std/pool.h"
 #include "std/pair.h"
 #include "std/delegate.h"
+#include "std/maths.h"
+#include "std/arr.h"
 
 #include "core/coroutine.h"
 
+struct JobCounter;
+
+// a flag jobs can wait on, instead of polling it with co::yield the job is
+// parked on the event and only put back in a queue once it is signalled
+struct JobEvent {
+    JobEvent(bool is_set = false);
+
+    // wakes up every job waiting on the event
+    void signal();
+    void reset();
+    bool isSet() const;
+
+    // parks the current job until the event is signalled,
+    // if called outside of a job it blocks the thread instead
+    void wait();
+
+private:
+    friend struct ThreadPool;
+
+    // either kset or the list of jobs waiting on the event
+    static constexpr uptr kset = 1;
+    std::atomic<uptr> state;
+    std::atomic<u32> generation = 0;
+    std::atomic<u32> thread_waiters = 0;
+    // events often live on the waiter's stack, wait doesn't return until
+    // signal is done touching the event
+    std::atomic<u32> signalling = 0;
+};
+
+// counts outstanding work, waiting on it parks the job until it goes back to zero.
+// add has to be called before the work it counts can finish, otherwise the
+// counter might be signalled while it still has work left
+struct JobCounter {
+    void add(int n = 1);
+    void done(int n = 1);
+    bool isDone() const;
+    void wait();
+
+    std::atomic<int> value = 0;
+    JobEvent event = JobEvent(true);
+};
+
 struct ThreadPool {
     using Job = Delegate<void()>;
 
-	void start(uint initial_thread_count = 5);
+    enum JobFlags : u8 {
+        None       = 0,
+        SmallStack = 1 << 0, // runs on a small coroutine stack, for jobs that don't recurse or use big locals
+        LargeStack = 1 << 1, // runs on a large coroutine stack
+        NoYield    = 1 << 2, // never yields, runs directly on the worker's stack without a coroutine
+        // workers always run critical jobs first, then normal ones, then background ones.
+        // a background job that yields lets any higher priority job run before it resumes
+        Critical   = 1 << 3, // per-frame work that the frame is waiting on
+        Background = 1 << 4, // streaming and other work that can take a few frames
+    };
+
+    struct WorkerStats {
+        u64 jobs_executed = 0;
+        u64 yields = 0;
+        u64 steals = 0;
+        // times another thread had to wake this worker up
+        u64 wakeups = 0;
+        u64 run_time_ns = 0;
+        u64 idle_time_ns = 0;
+        // most yields done by a single job, a big number usually means a job is polling
+        u64 max_job_yields = 0;
+        // deepest any of the worker's queues got
+        u64 queue_high_water = 0;
+
+        double avgRunTimeMs() const;
+        WorkerStats &operator+=(const WorkerStats &other);
+    };
+
+	// 0 means one worker per core, leaving one for the calling thread.
+	// does nothing if the pool is already running
+	void start(uint initial_thread_count = 0);
     void stop();
     bool isBusy();
-	void pushJob(Job &&job);
+	// if counter is not null, it is incremented now and decremented once the job is finished
+	void pushJob(Job &&job, JobCounter *counter = nullptr);
+	void pushJob(Job &&job, JobFlags flags, JobCounter *counter = nullptr);
     void setMaxJobsPerThread(uint max_jobs);
+    // hard limit on the number of workers, 0 means one per core
+    void setMaxThreads(uint max_threads);
+    // pins each worker to its own core, has to be called before start
+    void setPinToCores(bool pin);
+    // workers added on top of the initial ones exit after being idle for this long
+    void setIdleTimeout(uint ms);
+
+    // calls fn(begin, end) on sub ranges of at most grain elements, if grain is 0 it is picked
+    // automatically. the range is split recursively so idle workers can steal halves, and the
+    // calling thread works on it too instead of just waiting
+    template<typename Fn>
+    void parallelFor(usize begin, usize end, usize grain, Fn &&fn);
+
+    // fn(begin, end) returns the partial result for a sub range, partial results
+    // are combined in order with reduce(a, b)
+    template<typename T, typename Fn, typename ReduceFn>
+    T parallelReduce(usize begin, usize end, usize grain, T identity, Fn &&fn, ReduceFn &&reduce);
+
+    // stats are accumulated since start or the last resetStats
+    WorkerStats getWorkerStats(uint worker_index) const;
+    WorkerStats getTotalStats() const;
+    void resetStats();
+    // sends the stats to tracy as plots, call once per frame
+    void plotStats();
 
     usize getNumOfThreads() const;
     usize getThreadIndex(uptr thread_id) const;
-    const arr<Thread> &getThreads() const;
+    // the threads of the active workers
+    Slice<Thread> getThreads() const;
 
 private:
-    struct JobData {
+    friend struct JobEvent;
+
+    static constexpr uint kmax_workers = 64;
+
+    // lanes are in priority order
+    enum Lane : u8 {
+        CriticalLane,
+        NormalLane,
+        BackgroundLane,
+        LaneCount,
+    };
+
+    struct MpscNode {
+        std::atomic<MpscNode *> link;
+    };
+
+    // link is used by the inbox, next by the yield and wait lists
+    struct JobData : MpscNode {
         Job job;
         co::Coro coroutine;
+        JobCounter *counter = nullptr;
+        ThreadPool *pool = nullptr;
+        JobData *next = nullptr;
+        u64 yield_count = 0;
+        Lane lane = NormalLane;
+        // memory tag of whoever pushed it, or the one it was in when it last yielded
+        MemTag mem_tag = MemTag::Std;
     };
 
-    struct Queue {
-        struct Node {
-            JobData job_data;
-            Node *next = nullptr;
-        };
+    // relaxed atomics, so they can be read from any thread while the worker runs
+    struct AtomicStats {
+        void add(std::atomic<u64> &stat, u64 value);
+        void max(std::atomic<u64> &stat, u64 value);
+        WorkerStats load() const;
+        void reset();
+
+        std::atomic<u64> jobs_executed;
+        std::atomic<u64> yields;
+        std::atomic<u64> steals;
+        std::atomic<u64> wakeups;
+        std::atomic<u64> run_time_ns;
+        std::atomic<u64> idle_time_ns;
+        std::atomic<u64> max_job_yields;
+        std::atomic<u64> queue_high_water;
+    };
 
-        void init(void *wait_handle, void *stop_handle);
+    // Chase-Lev deque, the owner pushes and pops from the bottom (LIFO),
+    // every other worker steals from the top (FIFO)
+    struct WorkQueue {
+        static constexpr isize kcapacity = 4096;
+        static constexpr isize kmask = kcapacity - 1;
+
+        // returns false if the queue is full
+        bool push(JobData *job);
         JobData *pop();
-        void push(Job &&fn);
-        void yieldJob();
-        void finishJob();
-
-        int getJobCount();
-
-    private:
-        Node *head = nullptr;
-        Node *tail = nullptr;
-        Node *freelist = nullptr;
-        int job_count = 0;
-        Arena arena;
-
-        Mutex head_mtx;
-        Mutex tail_mtx;
-        Mutex free_mtx;
-        Mutex count_mtx;
-        Mutex arena_mtx;
-
-        void *wait_handle;
-        void *stop_handle;
+        JobData *steal();
+        isize size() const;
+
+        std::atomic<isize> top;
+        std::atomic<isize> bottom;
+        std::atomic<JobData *> buffer[kcapacity];
+    };
+
+    // Vyukov's intrusive queue, any thread can push but only one can pop at a time
+    struct MpscQueue {
+        void init();
+        void push(MpscNode *node);
+        // can return null while a push is halfway through, even if the queue isn't empty
+        MpscNode *pop();
+        bool isEmpty() const;
+
+        std::atomic<MpscNode *> head;
+        std::atomic<MpscNode *> tail;
+        MpscNode stub;
+    };
+
+    using RangeFn = void(void *udata, usize begin, usize end);
+
+    struct ParallelRange {
+        usize begin;
+        usize end;
+        usize grain;
+        RangeFn *fn;
+        void *udata;
+        JobCounter *counter;
+        JobFlags flags;
+    };
+
+    struct WorkerLane {
+        WorkQueue queue;
+
+        MpscQueue inbox;
+        // the owner normally drains the inbox, but handOff can too once the worker retired
+        std::atomic<bool> inbox_draining;
+
+        JobData *yield_head = nullptr;
+        JobData *yield_tail = nullptr;
+        bool run_yielded = false;
+    };
+
+    struct Worker {
+        void init(ThreadPool *owner, uint worker_index);
+
+        // jobs pushed from outside the pool, moved to the queue by the worker
+        void pushInbox(JobData *job);
+        // returns false if someone else is already draining it
+        bool lockInbox(Lane lane);
+        void unlockInbox(Lane lane);
+        JobData *popInbox(Lane lane);
+
+        // yielded jobs are only touched by the worker, so no need to lock
+        void pushYielded(JobData *job);
+        JobData *popYielded(Lane lane);
+
+        WorkerLane lanes[LaneCount];
+        AtomicStats stats;
+        // totals at the last plotStats, to plot per frame values
+        WorkerStats last_plotted;
+        // lane of the job the worker is running
+        Lane current_lane = NormalLane;
+        // set by JobEvent::wait before yielding, the job is parked instead of requeued
+        JobEvent *wait_event = nullptr;
+
+        std::atomic<bool> is_sleeping;
+        // extra workers retire once idle for too long, the Worker is kept and reused
+        std::atomic<bool> is_retired;
+        // bumped every time someone wakes the worker, it sleeps on it with futex::wait
+        std::atomic<u32> wake_signal;
+        ThreadPool *pool = nullptr;
+        uint index = 0;
     };
 
-	void threadLoop();
+	void threadLoop(Worker &worker);
     void pushThread();
-    Queue *getQueue();
+    // has to be called with queue_mtx locked
+    void spawnWorker();
+    void parallelForImpl(usize begin, usize end, usize grain, RangeFn *fn, void *udata);
+    void runRange(ParallelRange range);
+    // runs one job from the queues on the calling thread, returns false if there was nothing to run.
+    // only looks at max_lane and the lanes above it, threads outside of the pool only run NoYield jobs
+    bool helpOne(Lane max_lane);
+    // puts an already allocated job in one of the queues
+    void schedule(JobData *job);
+    // returns false if the event was already signalled
+    static bool parkJob(JobEvent &event, JobData *job);
+
+    JobData *allocJob();
+    void freeJob(JobData *job);
+    JobData *findJob(Worker &worker);
+    JobData *findJobInLane(Worker &worker, Lane lane);
+    // thief can be null when stealing from outside the pool
+    JobData *stealJob(Worker *thief, Lane lane);
+    void runJob(Worker &worker, JobData *job);
+    void finishJob(JobData *job);
+    // returns false if the worker retired and should exit
+    bool park(Worker &worker);
+    bool tryRetire(Worker &worker);
+    // moves the jobs that were pushed to a retired worker to the first one
+    void handOff(Worker &retired);
+    void wake(Worker &worker);
+    void wakeOne();
+    bool hasWork(Worker &worker);
 
-    bool should_stop = false;
-    arr<Thread> threads;
-    arr<Queue*> thread_queues;
-    arr<void*> wait_handles;
+    std::atomic<bool> should_stop = false;
+    // threads[i] runs workers[i]
+    Thread threads[kmax_workers];
+    Worker *workers[kmax_workers] = {};
+    std::atomic<uint> worker_count = 0;
+    std::atomic<uint> next_worker = 0;
+    std::atomic<int> job_count = 0;
     Arena queue_arena = Arena::make(gb(1), Arena::Virtual);
     uint max_jobs_per_thread = 5;
+    uint base_workers = 0;
+    uint max_workers = 0;
+    uint idle_timeout_ms = 2000;
+    bool pin_to_cores = false;
+
+    Pool<JobData, true> job_pool;
 
-    Mutex stop_mtx;
     Mutex queue_mtx;
 
-    void *stop_handle = nullptr;
+    static thread_local Worker *tls_worker;
 };
+
+template<typename Fn>
+void ThreadPool::parallelFor(usize begin, usize end, usize grain, Fn &&fn) {
+    // Fn is a reference when fn is an lvalue
+    using FnType = std::remove_reference_t<Fn>;
+    parallelForImpl(
+        begin, end, grain,
+        [](void *udata, usize range_begin, usize range_end) {
+            (*(FnType *)udata)(range_begin, range_end);
+        },
+        (void *)&fn
+    );
+}
+
+template<typename T, typename Fn, typename ReduceFn>
+T ThreadPool::parallelReduce(usize begin, usize end, usize grain, T identity, Fn &&fn, ReduceFn &&reduce) {
+    if (end <= begin) {
+        return identity;
+    }
+
+    if (grain == 0) {
+        grain = math::max<usize>((end - begin) / (getNumOfThreads() * 4 + 4), 1);
+    }
+
+    // one result per chunk, so that the result doesn't depend on which worker ran what
+    usize chunk_count = (end - begin + grain - 1) / grain;
+    arr<T> partials;
+    partials.reserve(chunk_count);
+    for (usize i = 0; i < chunk_count; ++i) {
+        partials.push(identity);
+    }
+
+    parallelFor(0, chunk_count, 1, [&](usize chunk_begin, usize chunk_end) {
+        for (usize c = chunk_begin; c < chunk_end; ++c) {
+            usize range_begin = begin + c * grain;
+            usize range_end = math::min(range_begin + grain, end);
+            partials[c] = fn(range_begin, range_end);
+        }
+    });
+
+    T result = identity;
+    for (const T &partial : partials) {
+        result = reduce(result, partial);
+    }
+    return result;
+}
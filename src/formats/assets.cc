@@ -8,9 +8,11 @@
 #include <json.hpp>
 #include <lz4.h>
 
+#include "std/arena.h"
 #include "std/file.h"
 #include "std/logging.h"
 #include "std/maths.h"
+#include "std/memtrack.h"
 #include "std/stream.h"
 
 static StrView std__to_strv(const std::string &str) {
@@ -21,6 +23,7 @@ static const char *asset__comp_as_str(Compression compression);
 static Compression asset__parse_compression(StrView compression);
 
 bool AssetFile::save(const char *path) const {
+    memtrack::TagScope mem_tag(MemTag::Formats);
     File fp;
     if (!fp.open(path, File::Write)) {
         err("could not open file %s to save asset", path);
@@ -37,6 +40,7 @@ bool AssetFile::save(const char *path) const {
 }
 
 bool AssetFile::load(const char *path) {
+    memtrack::TagScope mem_tag(MemTag::Formats);
     File fp;
     fp.open(path, File::Read);
 
@@ -80,6 +84,7 @@ struct InByteStream {
 };
 
 bool AssetFile::load(Slice<byte> data) {
+    memtrack::TagScope mem_tag(MemTag::Formats);
     InByteStream in = data;
     in.read(type);
     in.read(version);
@@ -137,6 +142,7 @@ void AssetTexture::unpack(Slice<byte> buffer, byte *destination) {
 }
 
 AssetFile AssetTexture::pack(byte *pixel_data) {
+    memtrack::TagScope mem_tag(MemTag::Formats);
     AssetFile file = {
         .type = { 'T', 'E', 'X', 'I' },
         .version = 1,
@@ -200,21 +206,23 @@ AssetMesh AssetMesh::readInfo(const AssetFile &file) {
 }
 
 void AssetMesh::unpack(Slice<byte> buffer, byte *dest_vbuf, byte *dest_ibuf) {
-    arr<char> decompress_buffer;
-    decompress_buffer.resize(vbuf_size + ibuf_size);
+    ScratchScope scratch = Arena::scratch();
+    usize decompress_size = vbuf_size + ibuf_size;
+    char *decompress_buffer = scratch->alloc<char>(decompress_size, Arena::NoZero);
 
     LZ4_decompress_safe(
         (const char *)buffer.data(),
-        decompress_buffer.data(),
+        decompress_buffer,
         (int)buffer.size(),
-        (int)decompress_buffer.size()
+        (int)decompress_size
     );
 
-    memcpy(dest_vbuf, decompress_buffer.data(), vbuf_size);
-    memcpy(dest_ibuf, decompress_buffer.data() + vbuf_size, ibuf_size);
+    memcpy(dest_vbuf, decompress_buffer, vbuf_size);
+    memcpy(dest_ibuf, decompress_buffer + vbuf_size, ibuf_size);
 }
 
 AssetFile AssetMesh::pack(const byte *vertices, const byte *indices) {
+    memtrack::TagScope mem_tag(MemTag::Formats);
     AssetFile file = {
         .type = { 'M', 'E', 'S', 'H' },
         .version = 1,
@@ -3,6 +3,7 @@
 #include "std/stream.h"
 #include "std/arena.h"
 #include "std/file.h"
+#include "std/memtrack.h"
 
 // == VALUE ==============================================================================================
 
@@ -35,17 +36,20 @@ bool Ini::Value::asBool(bool default_value) const {
 }
 
 Str Ini::Value::asStr(const Str &default_value) const {
+    memtrack::TagScope mem_tag(MemTag::Formats);
     if (value.empty()) return default_value;
     InStream in = value;
     return in.getStr('\0');
 }
 
 Str Ini::Value::asStr(Arena &arena, const Str &default_value) const {
+    memtrack::TagScope mem_tag(MemTag::Formats);
     if (value.empty()) return default_value;
     InStream in = value;
     return in.getStr(arena, '\0');
 }
 arr<StrView> Ini::Value::asArr(char delim, const Slice<StrView> &default_value) const {
+    memtrack::TagScope mem_tag(MemTag::Formats);
     if (value.empty()) return default_value.dup();
     if (!delim) delim = ',';
     
@@ -155,6 +159,10 @@ void ini__add_table(Ini &ini, InStream &in, const Ini::Options &options) {
 }
 
 void ini__parse(Ini &ini, const Ini::Options &options) {
+    // the tables keep views into text, it can't be stored inline or they would
+    // point to the old Ini once it's moved
+    ini.text.reserve(Str::kmax_small + 1);
+
     InStream in = StrView(ini.text);
 
     in.skipWhitespace();
@@ -176,12 +184,14 @@ void ini__parse(Ini &ini, const Ini::Options &options) {
 }
 
 Ini Ini::parse(const char *filename, const Options &options) {
+    memtrack::TagScope mem_tag(MemTag::Formats);
     Ini ini = { .text = File::readWholeText(filename) };
     ini__parse(ini, options);
     return ini;
 }
 
 Ini Ini::parseStr(const char *inistr, const Options &options) {
+    memtrack::TagScope mem_tag(MemTag::Formats);
     Ini ini = { .text = inistr };
     ini__parse(ini, options);
     return ini;
@@ -272,6 +272,6 @@ VkDescriptorSet DescriptorBuilder::build() {
     return build(layout);
 }
 
-u32 hash_impl(const DescriptorLayoutCache::DescriptorLayoutInfo &v) {
-    return hashFnv132(v.bindings.data(), v.bindings.byteSize());
+u64 hash_impl(const DescriptorLayoutCache::DescriptorLayoutInfo &v) {
+    return hashBytes(v.bindings.data(), v.bindings.byteSize());
 }
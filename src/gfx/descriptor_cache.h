@@ -60,7 +60,7 @@ private:
     Mutex cache_mtx;
 };
 
-u32 hash_impl(const DescriptorLayoutCache::DescriptorLayoutInfo &v);
+u64 hash_impl(const DescriptorLayoutCache::DescriptorLayoutInfo &v);
 
 struct DescriptorBuilder {
     DescriptorBuilder(DescriptorLayoutCache &c, DescriptorAllocator &a);
@@ -18,6 +18,8 @@
 #include "std/mem.h"
 #include "std/file.h"
 #include "std/callstack.h"
+#include "std/arena_arr.h"
+#include "std/memtrack.h"
 
 #include "assets/asset_manager.h"
 
@@ -57,10 +59,11 @@ static u32 vulkan_print_callback(
 static void setImGuiTheme();
 
 void Engine::init() {
+	memtrack::TagScope mem_tag(MemTag::Gfx);
 	info("Initializing");
 
 	CallStack::init();
-	jobpool.start(5);
+	jobpool.start();
 
 	// We initialize SDL and create a window with it. 
 	SDL_Init(SDL_INIT_VIDEO);
@@ -119,6 +122,7 @@ void Engine::cleanup() {
 }
 
 void Engine::run() {
+	memtrack::TagScope mem_tag(MemTag::Gfx);
 	SDL_Event e;
 	bool should_quit = false;
 
@@ -165,6 +169,9 @@ void Engine::run() {
 
 		drawFpsWidget();
 		draw();
+
+		jobpool.plotStats();
+		tracy_helper.plotMemory();
 	}
 }
 
@@ -218,25 +225,27 @@ VkShaderModule Engine::loadShaderModule(const char *path) {
 }
 
 Material *Engine::makeMaterial(VkPipeline pipeline, VkPipelineLayout layout, StrView name) {
+	memtrack::TagScope mem_tag(MemTag::Gfx);
 	Material mat = {
 		.pipeline_ref = pipeline,
 		.layout_ref = layout,
 	};
-	return m_materials.push(name, mem::move(mat));
+	return m_materials.push(StrId::intern(name), mem::move(mat));
 }
 
-Material *Engine::getMaterial(StrView name) {
+Material *Engine::getMaterial(StrId name) {
 	return m_materials.get(name);
 }
 
 Mesh *Engine::loadMesh(const char *asset_path, StrView name) {
+	memtrack::TagScope mem_tag(MemTag::Gfx);
 	Mesh mesh;
 	mesh.load(asset_path, name);
 	// mesh.upload();
-	return m_meshes.push(name, mem::move(mesh));
+	return m_meshes.push(StrId::intern(name), mem::move(mesh));
 }
 
-Mesh *Engine::getMesh(StrView name) {
+Mesh *Engine::getMesh(StrId name) {
 	return m_meshes.get(name);
 }
 
@@ -874,6 +883,9 @@ void Engine::draw() {
 
 	PK_VKCHECK(vkWaitForFences(m_device, 1, frame.render_fence.getRef(), true, 1000000000));
 	PK_VKCHECK(vkResetFences(m_device, 1, frame.render_fence.getRef()));
+
+	// the gpu is done with everything allocated the last time this frame was used
+	frame.arena.rewind(0);
 	
 	PK_VKCHECK(vkResetCommandBuffer(frame.cmd_buf, 0));
 
@@ -1013,9 +1025,11 @@ void Engine::drawObjects(VkCommandBuffer cmd, Slice<RenderObject> objects) {
 
 	ObjectData *gpu_objects = object_buf->map<ObjectData>();
 
-	for (usize i = 0; i < objects.len; ++i) {
-		gpu_objects[i].model = objects[i].matrix;
-	}
+	jobpool.parallelFor(0, objects.len, 1024, [gpu_objects, objects](usize begin, usize end) {
+		for (usize i = begin; i < end; ++i) {
+			gpu_objects[i].model = objects[i].matrix;
+		}
+	});
 
 	object_buf->unmap();
 
@@ -1028,7 +1042,7 @@ void Engine::drawObjects(VkCommandBuffer cmd, Slice<RenderObject> objects) {
 		u32 count;
 	};
 
-	arr<Batch> batches;
+	ArenaArr<Batch> batches(frame.arena, 64);
 
 	Mesh *last_mesh = nullptr;
 	Material *last_material = nullptr;
@@ -1165,6 +1179,10 @@ Engine::FrameData &Engine::getCurrentFrame() {
 	return m_frames[m_frame_num % kframe_overlap];
 }
 
+Arena &Engine::getFrameArena() {
+	return getCurrentFrame().arena;
+}
+
 static u32 vulkan_print_callback(
 	VkDebugUtilsMessageSeverityFlagBitsEXT      messageSeverity,
 	VkDebugUtilsMessageTypeFlagsEXT             messageTypes,
@@ -1263,10 +1281,10 @@ void Engine::AsyncQueue::init(VkQueue in_queue, u32 in_family, bool use_fence) {
 	queue = in_queue;
 	family = in_family;
 
-	const arr<Thread> &threads = g_engine->jobpool.getThreads();
+	usize worker_count = g_engine->jobpool.getNumOfThreads();
 
-	for (const Thread &thr : threads) {
-		addPool(thr.getId());
+	for (usize i = 0; i < worker_count; ++i) {
+		addPool(i, 0);
 	}
 
 	VkFenceCreateInfo fence_info = {
@@ -1407,7 +1425,7 @@ VkCommandBuffer Engine::AsyncQueue::allocCmd() {
 	return cmd;
 }
 
-void Engine::AsyncQueue::addPool(uptr thread_id) {
+u32 Engine::AsyncQueue::addPool(usize worker_index, uptr thread_id) {
 	VkCommandPoolCreateInfo cmdpool_info = {
 		.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
 		// allow pool to reset individual command buffers
@@ -1425,41 +1443,46 @@ void Engine::AsyncQueue::addPool(uptr thread_id) {
 	PK_VKCHECK(vkCreateCommandPool(g_engine->m_device, &cmdpool_info, nullptr, &new_pool));
 
 	PoolData data;
-	data.thread_id = Thread::currentId();
+	data.worker_index = worker_index;
+	data.thread_id = thread_id;
 	data.pool = new_pool;
 
 	pool_mtx.lock();
+	u32 index = (u32)pools.len;
 	pools.push(mem::move(data));
 	pool_mtx.unlock();
 
 	// TODO could preallocate a few buffers and put them in the freelist
 
-	if (!fence) return;
+	if (!fence) return index;
 
 	pool_mtx.lock();
 	cmdalloc_info.commandPool = new_pool;
 	PK_VKCHECK(vkAllocateCommandBuffers(g_engine->m_device, &cmdalloc_info, &cmdbuf));
 	pool_mtx.unlock();
+
+	return index;
 }
 
 u32 Engine::AsyncQueue::getPoolIndex() {
-	// try to find the queue
+	// a worker that retires and is started again gets a new thread id,
+	// so workers are found by index and only other threads by id
 	uptr thread_id = Thread::currentId();
+	usize worker_index = g_engine->jobpool.getThreadIndex(thread_id);
+	if (worker_index != SIZE_MAX) {
+		thread_id = 0;
+	}
 
 	pool_mtx.lock();
 	for (usize i = 0; i < pools.len; ++i) {
-		if (pools[i].thread_id == thread_id) {
+		if (pools[i].worker_index == worker_index && pools[i].thread_id == thread_id) {
 			pool_mtx.unlock();
 			return (u32)i;
 		}
 	}
-
-	u32 index = (u32)pools.len;
 	pool_mtx.unlock();
 
-	addPool(thread_id);
-
-	return index;
+	return addPool(worker_index, thread_id);
 }
 
 void Engine::AsyncQueue::resetSubmitList() {
@@ -6,7 +6,9 @@
 #include <glm/mat4x4.hpp>
 
 #include "std/arr.h"
+#include "std/arena.h"
 #include "std/str.h"
+#include "std/str_id.h"
 #include "std/slice.h"
 #include "std/hashmap.h"
 #include "std/vec.h"
@@ -46,11 +48,12 @@ struct Engine {
 
     VkShaderModule loadShaderModule(const char *path);
 
+    // the name is interned, lookups only compare the ids
     Material *makeMaterial(VkPipeline pipeline, VkPipelineLayout layout, StrView name);
-    Material *getMaterial(StrView name);
+    Material *getMaterial(StrId name);
 
     Mesh *loadMesh(const char *asset_path, StrView name);
-    Mesh *getMesh(StrView name);
+    Mesh *getMesh(StrId name);
 
     // Buffer makeBuffer(usize size, VkBufferUsageFlags usage, VmaMemoryUsage memory_usage);
 
@@ -78,6 +81,7 @@ struct Engine {
     void drawFpsWidget();
 
     FrameData &getCurrentFrame();
+    Arena &getFrameArena();
 
     // -- types --
 
@@ -96,11 +100,15 @@ struct Engine {
 
         struct PoolData {
             vkptr<VkCommandPool> pool;
+            // SIZE_MAX for threads outside of the job pool
+            usize worker_index;
+            // only set for threads outside of the job pool
             uptr thread_id;
             arr<VkCommandBuffer> freelist;
         };
 
-        void addPool(uptr thread_id);
+        // returns the index of the new pool
+        u32 addPool(usize worker_index, uptr thread_id);
         u32 getPoolIndex();
 
         VkQueue queue;
@@ -131,6 +139,9 @@ struct Engine {
         Handle<Buffer> object_buf;
         VkDescriptorSet object_descriptor;
         AsyncQueue async_gfx;
+        // per frame memory, rewound once render_fence is signalled so it's safe
+        // to use for anything that has to live until the gpu is done with the frame
+        Arena arena = Arena::make(mb(64), Arena::Virtual);
     };
 
     struct SceneData {
@@ -220,8 +231,8 @@ struct Engine {
     arr<vkptr<VkSampler>> m_sampler_cache;
     
 	arr<RenderObject> m_drawable;
-	HashMap<StrView, Material> m_materials;
-	HashMap<StrView, Mesh> m_meshes;
+	HashMap<StrId, Material> m_materials;
+	HashMap<StrId, Mesh> m_meshes;
     Material *default_material = nullptr;
 	//HashMap<StrView, Texture> m_textures;
     
@@ -96,7 +96,6 @@ void mesh__upload(Handle<Buffer> out, VkBufferUsageFlagBits vert_or_ind, const v
 
 void Mesh2::load(StrView fname, StrView name) {
 	Str filename = fname;
-	Str mesh_name = name;
 
 	Handle<Buffer> vbuf  = Buffer::makeAsync();
 	Handle<Buffer> libuf = Buffer::makeAsync();
@@ -114,14 +113,13 @@ void Mesh2::load(StrView fname, StrView name) {
 		 	local_ind_buf = libuf,
 		 	global_ind_buf = gibuf,
 		 	meshlets = mbuf, 
-		 	name = mem::move(mesh_name), 
 		 	fname = mem::move(filename)
 		]
 		() {
 			asio::File file;
 			file.init(fname);
 			if (!file.isValid()) {
-				err("failed to load asset file %s", fname);
+				err("failed to load asset file %s", fname.cstr());
 				return;
 			}
 
@@ -133,7 +131,7 @@ void Mesh2::load(StrView fname, StrView name) {
 
 			AssetFile asset;
 			if (!asset.load(file_data)) {
-				err("failed to load asset file %s", fname);
+				err("failed to load asset file %s", fname.cstr());
 				return;
 			}
 
@@ -171,13 +169,14 @@ void Mesh2::load(StrView fname, StrView name) {
 			//}
 
 			info("finished loading model %s", fname.cstr());
-		}
+		},
+		ThreadPool::Background
 	);
 }
 
 bool Mesh::load(const char *fname, StrView name, arr<Meshlet> *gen_meshlets) {
 	Str filename = fname;
-	Str mesh_name = name;
+	StrId mesh_id = StrId::intern(name);
 
 	Handle<Buffer> vrt_buf = Buffer::makeAsync();
 	Handle<Buffer> ind_buf = Buffer::makeAsync();
@@ -186,12 +185,12 @@ bool Mesh::load(const char *fname, StrView name, arr<Meshlet> *gen_meshlets) {
 	ibuf = ind_buf;
 
 	g_engine->jobpool.pushJob(
-		[vrt_buf, ind_buf, gen_meshlets, name = mem::move(mesh_name), fname = mem::move(filename)]
+		[vrt_buf, ind_buf, gen_meshlets, mesh_id, fname = mem::move(filename)]
 		() {
 			asio::File file;
 			file.init(fname);
 			if (!file.isValid()) {
-				err("failed to load asset file %s", fname);
+				err("failed to load asset file %s", fname.cstr());
 				return;
 			}
 
@@ -203,7 +202,7 @@ bool Mesh::load(const char *fname, StrView name, arr<Meshlet> *gen_meshlets) {
 
 			AssetFile asset;
 			if (!asset.load(file_data)) {
-				err("failed to load asset file %s", fname);
+				err("failed to load asset file %s", fname.cstr());
 				return;
 			}
 
@@ -216,7 +215,7 @@ bool Mesh::load(const char *fname, StrView name, arr<Meshlet> *gen_meshlets) {
 			verts.grow(info.vbuf_size / sizeof(Vertex));
 			indices.grow(info.ibuf_size / info.index_size);
 			
-			if (Mesh *mesh = g_engine->m_meshes.get(name)) {
+			if (Mesh *mesh = g_engine->m_meshes.get(mesh_id)) {
 				mesh->index_count = (u32)indices.len;
 			}
 
@@ -225,8 +224,8 @@ bool Mesh::load(const char *fname, StrView name, arr<Meshlet> *gen_meshlets) {
 			mesh__upload(vrt_buf, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, verts.data(), verts.byteSize());
 			mesh__upload(ind_buf, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, indices.data(), indices.byteSize());
 
-			while (!vrt_buf.isLoaded()) co::yield();
-			while (!ind_buf.isLoaded()) co::yield();
+			vrt_buf.waitUntilLoaded();
+			ind_buf.waitUntilLoaded();
 
 			if (gen_meshlets) {
 				Meshlet meshlet = {};
@@ -241,7 +240,8 @@ bool Mesh::load(const char *fname, StrView name, arr<Meshlet> *gen_meshlets) {
 			}
 
 			info("finished loading model %s", fname.cstr());
-		}
+		},
+		ThreadPool::Background
 	);
 	
 	return true;
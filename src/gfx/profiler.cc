@@ -5,7 +5,7 @@
 
 // VULKAN SCOPE TIMER /////////////////////////////////////////////////////////
 
-ScopeTimer::ScopeTimer(VkCommandBuffer commands, Profiler &profiler, StrView name) 
+ScopeTimer::ScopeTimer(VkCommandBuffer commands, Profiler &profiler, StrId name) 
     : profiler(profiler),
       cmd(commands),
       name(name)
@@ -34,7 +34,7 @@ ScopeTimer::~ScopeTimer() {
 
 // VULKAN PIPELINE STAT RECORDER //////////////////////////////////////////////
 
-PipelineStatRecorder::PipelineStatRecorder(VkCommandBuffer commands, Profiler &profiler, StrView name)
+PipelineStatRecorder::PipelineStatRecorder(VkCommandBuffer commands, Profiler &profiler, StrId name)
     : profiler(profiler),
       cmd(commands),
       name(name)
@@ -160,10 +160,10 @@ u32 Profiler::getStatId() {
     return out;
 }
 
-void Profiler::pushTimer(StrView name, u32 start_id, u32 end_id) {
+void Profiler::pushTimer(StrId name, u32 start_id, u32 end_id) {
     query_frames[current_frame].timers.push({ name, start_id, end_id });
 }
 
-void Profiler::pushStat(StrView name, u32 query) {
+void Profiler::pushStat(StrId name, u32 query) {
     query_frames[current_frame].stats.push({ name, query });
 }
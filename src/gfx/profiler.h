@@ -4,30 +4,32 @@
 #include "std/hashmap.h"
 #include "std/arr.h"
 #include "std/str.h"
+#include "std/str_id.h"
 
 #include "vk_fwd.h"
 #include "vk_ptr.h"
 
 struct Profiler;
 
+// the results are keyed by name, use StrId::intern for names that have to be printed
 struct ScopeTimer {
-    ScopeTimer(VkCommandBuffer commands, Profiler &profiler, StrView name);
+    ScopeTimer(VkCommandBuffer commands, Profiler &profiler, StrId name);
     ~ScopeTimer();
 
     Profiler &profiler;
     VkCommandBuffer cmd;
-    StaticStr<64> name;
+    StrId name;
     u32 start_time;
     u32 end_time;
 };
 
 struct PipelineStatRecorder {
-    PipelineStatRecorder(VkCommandBuffer commands, Profiler &profiler, StrView name);
+    PipelineStatRecorder(VkCommandBuffer commands, Profiler &profiler, StrId name);
     ~PipelineStatRecorder();
 
     Profiler &profiler;
     VkCommandBuffer cmd;
-    StaticStr<64> name;
+    StrId name;
     u32 query;
 };
 
@@ -42,21 +44,21 @@ struct Profiler {
     u32 getTimestampId();
     u32 getStatId();
 
-    void pushTimer(StrView name, u32 start_id, u32 end_id);
-    void pushStat(StrView name, u32 query);
+    void pushTimer(StrId name, u32 start_id, u32 end_id);
+    void pushStat(StrId name, u32 query);
 
-    HashMap<StrView, double> timing;
-    HashMap<StrView, i32> stats;
+    HashMap<StrId, double> timing;
+    HashMap<StrId, i32> stats;
 
 private:
     struct Timer {
-        StaticStr<64> name;
+        StrId name;
         u32 start_id;
         u32 end_id;
     };
 
     struct Stat {
-        StaticStr<64> name;
+        StrId name;
         u32 query;
     };
 
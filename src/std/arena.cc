@@ -7,13 +7,14 @@
 #include "vmem.h"
 #include "mem.h"
 #include "logging.h"
+#include "memtrack.h"
 
 static constexpr usize arena__calc_padding(usize amount, usize align) {
 #pragma warning(suppress : 4146)
     return -(usize)amount & (align - 1);
 }
 
-static Arena arena__make_virtual(usize initial_allocation);
+static Arena arena__make_virtual(usize initial_allocation, Arena::Type type);
 static Arena arena__make_malloc(usize initial_allocation);
 static Arena arena__make_static(byte *data, usize len);
 
@@ -25,7 +26,7 @@ static void *arena__alloc_simple(Arena &self, usize size, usize align, usize cou
 
 Arena Arena::make(usize initial_allocation, Type type) {
     switch (type & __TypeMask) {
-        case Virtual: return arena__make_virtual(initial_allocation);
+        case Virtual: return arena__make_virtual(initial_allocation, type);
         case Malloc:  return arena__make_malloc(initial_allocation);
         case Static:  err("Can't initialise static arena using Arena::make, call Arena::makeStatic with your buffer instead"); break;
         default:      err("Invalid arena type provided: %u %u", type, type & __TypeMask); break;
@@ -38,6 +39,21 @@ Arena Arena::makeStatic(byte *data, usize len) {
     return arena__make_static(data, len);
 }
 
+static thread_local Arena arena__scratch[2];
+#if PK_DEBUG
+static thread_local uint arena__open_scratch = 0;
+#endif
+
+ScratchScope Arena::scratch(const Arena *conflict) {
+    Arena &arena = &arena__scratch[0] == conflict ? arena__scratch[1] : arena__scratch[0];
+    if (!arena.start) {
+        arena = Arena::make(gb(1), Virtual);
+        // give back the memory when a big temporary allocation is done with it
+        arena.setCommitPolicy(kb(64), mb(16));
+    }
+    return ScratchScope(arena);
+}
+
 Arena::Arena(const Arena &arena) {
     *this = arena;
 }
@@ -85,6 +101,37 @@ void Arena::rewind(usize from_start) {
         return;
     }
     current = start + from_start;
+
+    if (decommit_threshold && (type & __TypeMask) == Virtual) {
+        usize unused = committed - (start + vmem::padToPage(from_start));
+        if (unused > decommit_threshold) {
+            trim();
+        }
+    }
+}
+
+void Arena::trim() {
+    if ((type & __TypeMask) != Virtual || !start) {
+        return;
+    }
+
+    // keep the first page committed like when the arena was made
+    byte *page_start = start + vmem::padToPage(tell());
+    if (page_start >= committed) {
+        return;
+    }
+
+    if (vmem::decommit(page_start, (committed - page_start) / vmem::getPageSize())) {
+#if PK_TRACK_ALLOCS
+        memtrack::trackArena(0, -(isize)(committed - page_start));
+#endif
+        committed = page_start;
+    }
+}
+
+void Arena::setCommitPolicy(usize chunk_size, usize threshold) {
+    commit_chunk = vmem::padToPage(chunk_size);
+    decommit_threshold = threshold;
 }
 
 void Arena::pop(usize amount) {
@@ -104,62 +151,123 @@ Arena &Arena::operator=(Arena &&other) {
         mem::swap(start, other.start);
         mem::swap(current, other.current);
         mem::swap(end, other.end);
+        mem::swap(committed, other.committed);
+        mem::swap(commit_chunk, other.commit_chunk);
+        mem::swap(decommit_threshold, other.decommit_threshold);
         mem::swap(type, other.type);
     }
     return *this;
 }
 
+ScratchScope::ScratchScope(Arena &arena)
+    : arena(&arena), position(arena.tell())
+{
+#if PK_DEBUG
+    if (&arena == &arena__scratch[0] || &arena == &arena__scratch[1]) {
+        ++arena__open_scratch;
+    }
+#endif
+}
+
+ScratchScope::~ScratchScope() {
+    arena->rewind(position);
+#if PK_DEBUG
+    if (arena == &arena__scratch[0] || arena == &arena__scratch[1]) {
+        --arena__open_scratch;
+    }
+#endif
+}
+
+#if PK_DEBUG
+uint ScratchScope::openCount() {
+    return arena__open_scratch;
+}
+#endif
+
 // == VIRTUAL ARENA ====================================================================================================
 
-static Arena arena__make_virtual(usize initial_allocation) {
+static Arena arena__make_virtual(usize initial_allocation, Arena::Type type) {
     usize alloc_size = 0;
     byte *ptr = (byte *)vmem::init(initial_allocation, &alloc_size);
-    if (!vmem::commit(ptr, 1)) {
+    if (ptr && !vmem::commit(ptr, 1)) {
         vmem::release(ptr);
         ptr = nullptr;
     }
 
+#if PK_TRACK_ALLOCS
+    if (ptr) {
+        memtrack::trackArena((isize)alloc_size, (isize)vmem::getPageSize());
+    }
+#endif
+
+    if (ptr && (type & Arena::HugePages)) {
+        vmem::adviseHugePages(ptr, alloc_size);
+    }
+
     Arena out;
     out.start = ptr;
     out.current = ptr;
     out.end = ptr ? ptr + alloc_size : nullptr;
-    out.type = Arena::Virtual;
+    out.committed = ptr ? ptr + vmem::getPageSize() : nullptr;
+    // no point in committing less than a huge page at a time
+    out.commit_chunk = (type & Arena::HugePages) ? mb(2) : kb(64);
+    out.type = (Arena::Type)(Arena::Virtual | (type & Arena::HugePages));
     return out;
 }
 
 static void arena__free_virtual(Arena &self) {
     if (!self.start) return;
 
+#if PK_TRACK_ALLOCS
+    memtrack::trackArena(-(isize)(self.end - self.start), -(isize)(self.committed - self.start));
+#endif
+
     if (!vmem::release(self.start)) {
         err("failed to free virtual memory");
     }
 }
 
 static void *arena__alloc_virtual(Arena &self, usize size, usize align, usize count, Arena::Flags flags) {
-    isize total = size * count;
-    
-    usize allocated = self.tell();
-    usize page_end = vmem::padToPage(allocated);
+    usize total = size * count;
+    usize padding = arena__calc_padding((usize)self.current, align);
 
-    if (total > (isize)(page_end - allocated)) {
-        usize page_size = vmem::getPageSize();
-        usize new_memory_end = page_end + vmem::padToPage(total);
-        usize num_of_pages = new_memory_end / page_size;
+    if (total + padding > (usize)(self.end - self.current)) {
+        err("virtual arena is out of reserved memory, trying to allocate %zu bytes", total);
+        if (flags & Arena::SoftFail) {
+            return nullptr;
+        }
+        fatal("Virtual arena allocation fail");
+    }
 
-        pk_assert(num_of_pages > 0);
+    byte *ptr = self.current + padding;
+    byte *new_current = ptr + total;
 
-        if (!vmem::commit(self.start, num_of_pages)) {
-            err("arena could not commit %zi pages", num_of_pages);
+    // only commit what comes after the high water mark, a chunk at a time
+    if (new_current > self.committed) {
+        usize page_size = vmem::getPageSize();
+        usize chunk = self.commit_chunk > page_size ? self.commit_chunk : page_size;
+        usize needed = new_current - self.committed;
+        usize commit_size = ((needed + chunk - 1) / chunk) * chunk;
+        usize available = self.end - self.committed;
+        if (commit_size > available) {
+            commit_size = available;
+        }
+
+        if (!vmem::commit(self.committed, commit_size / page_size)) {
+            err("arena could not commit %zu pages", commit_size / page_size);
             if (flags & Arena::SoftFail) {
                 return nullptr;
             }
             fatal("Virtual arena allocation fail");
         }
+
+#if PK_TRACK_ALLOCS
+        memtrack::trackArena(0, (isize)commit_size);
+#endif
+        self.committed += commit_size;
     }
 
-    usize padding = arena__calc_padding((usize)self.current, align);
-    byte *ptr = self.current + padding;
-    self.current += padding + total;
+    self.current = new_current;
     return flags & Arena::NoZero ? ptr : memset(ptr, 0, total);
 }
 
@@ -6,13 +6,17 @@ constexpr usize kb(usize b) { return b * 1024; }
 constexpr usize mb(usize b) { return kb(b) * 1024; }
 constexpr usize gb(usize b) { return mb(b) * 1024; }
 
+struct ScratchScope;
+
 struct Arena {
     enum Type : u8 {
         Virtual  = 1 << 0, // using virtual memory (allocates only when needed)
         Malloc   = 1 << 1, // using malloc (preallocates memory on heap)
         Static   = 1 << 2, // using static buffer (you will need to provide it!)
-        
-        __TypeMask = 0x7F,
+
+        HugePages = 1 << 3, // virtual only, hint the os to use huge pages, for big arenas
+
+        __TypeMask = 0x07,
         __NotOwned = 1 << 7,
     };
 
@@ -24,6 +28,12 @@ struct Arena {
 
     static Arena make(usize initial_allocation, Type type = Type::Virtual);
     static Arena makeStatic(byte *data, usize len);
+    // each thread has two scratch arenas for temporary allocations, the returned scope
+    // rewinds it once it ends. if the caller already got one and passes it as conflict
+    // the other one is returned, so nested scratch allocations don't overwrite each other.
+    // never yield or wait on a job event while the scope is open: the job could resume on
+    // another worker, and the job that runs here in the meantime would reuse the arena
+    static ScratchScope scratch(const Arena *conflict = nullptr);
     template<usize size>
     static Arena makeStatic(byte (&data)[size]) {
         return makeStatic(data, size);
@@ -39,11 +49,16 @@ struct Arena {
     void *alloc(usize size, usize count, usize align = 1, Flags flags = Flags::None);
     template<typename T>
     T *alloc(usize count = 1, Flags flags = Flags::None, usize size = sizeof(T), usize align = alignof(T)) {
-        return (T *)alloc(size, align, count, flags);
+        return (T *)alloc(size, count, align, flags);
     }
 
     usize tell() const;
     void rewind(usize from_start);
+    // gives the memory after the current position back to the os, only for virtual arenas
+    void trim();
+    // virtual only: memory is committed chunk_size bytes at a time, and a rewind that leaves
+    // more than decommit_threshold bytes of committed memory unused gives it back (0 never does)
+    void setCommitPolicy(usize chunk_size, usize decommit_threshold = 0);
     void pop(usize amount);
     template<typename T>
     void pop(usize count = 1) { pop(sizeof(T) * count); }
@@ -54,5 +69,27 @@ struct Arena {
     byte *start = nullptr;
     byte *current = nullptr;
     byte *end = nullptr;
+    // virtual only, everything in [start, committed) is already usable
+    byte *committed = nullptr;
+    usize commit_chunk = kb(64);
+    usize decommit_threshold = 0;
     Type type = Type::Virtual;
-};
\ No newline at end of file
+};
+
+struct ScratchScope {
+    ScratchScope(Arena &arena);
+    ~ScratchScope();
+    ScratchScope(const ScratchScope &) = delete;
+    ScratchScope &operator=(const ScratchScope &) = delete;
+
+    Arena *operator->() { return arena; }
+    Arena &operator*() { return *arena; }
+
+#if PK_DEBUG
+    // scratch scopes open on the calling thread, co::yield and JobEvent::wait assert it's zero
+    static uint openCount();
+#endif
+
+    Arena *arena;
+    usize position;
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <new>
+#include <string.h>
+#include <type_traits>
+
+#include "common.h"
+#include "arena.h"
+#include "slice.h"
+
+// growable array that lives in an arena, for temporary lists that would otherwise be an arr.
+// destructors are never called and the memory is only given back when the arena is
+// rewound, so it's meant for trivial types in frame or scratch arenas
+template<typename T>
+struct ArenaArr {
+	static_assert(std::is_trivially_destructible_v<T>, "ArenaArr never calls destructors");
+
+	using iterator = T *;
+	using const_iterator = const T *;
+
+	ArenaArr() = default;
+	ArenaArr(Arena &arena, usize initial_cap = 0) : arena(&arena) {
+		if (initial_cap) reserve(initial_cap);
+	}
+
+	void reserve(usize new_cap) {
+		if (new_cap <= cap) {
+			return;
+		}
+		pk_assert(arena);
+
+		// when nothing was allocated after us we can just extend the buffer in place
+		byte *buf_end = (byte *)(buf + cap);
+		if (buf && buf_end == arena->current) {
+			if (arena->alloc(sizeof(T), new_cap - cap, 1, Arena::NoZero)) {
+				cap = new_cap;
+				return;
+			}
+		}
+
+		new_cap = math::max(new_cap, cap * 2);
+		T *new_buf = arena->alloc<T>(new_cap, Arena::NoZero);
+		if (len) {
+			memcpy(new_buf, buf, sizeof(T) * len);
+		}
+		buf = new_buf;
+		cap = new_cap;
+	}
+
+	template<typename ...TArgs>
+	T &push(TArgs &&...args) {
+		reserve(len + 1);
+		return *new (buf + len++) T(mem::forward<TArgs>(args)...);
+	}
+
+	void pop() { if (len) --len; }
+	void clear() { len = 0; }
+
+	bool empty() const { return len == 0; }
+	T *data() { return buf; }
+	const T *data() const { return buf; }
+	usize size() const { return len; }
+	usize byteSize() const { return len * sizeof(T); }
+
+	T &back() { pk_assert(len); return buf[len - 1]; }
+	const T &back() const { pk_assert(len); return buf[len - 1]; }
+
+	T &operator[](usize i) { pk_assert(i < len); return buf[i]; }
+	const T &operator[](usize i) const { pk_assert(i < len); return buf[i]; }
+
+	operator Slice<T>() const { return Slice<T>(buf, len); }
+
+	T *begin() { return buf; }
+	T *end() { return buf + len; }
+	const T *begin() const { return buf; }
+	const T *end() const { return buf + len; }
+
+	T *buf = nullptr;
+	usize len = 0;
+	usize cap = 0;
+	Arena *arena = nullptr;
+};
+
+template<typename T>
+Slice<T> arenaDup(Arena &arena, Slice<T> slice) {
+	T *buf = arena.alloc<T>(slice.len, Arena::NoZero);
+	memcpy(buf, slice.buf, slice.byteSize());
+	return Slice<T>(buf, slice.len);
+}
@@ -1,7 +1,9 @@
 #pragma once
 
 #include <limits.h>
+#include <new>
 #include <initializer_list>
+#include <type_traits>
 
 #include <assert.h>
 #include <stdlib.h>
@@ -17,7 +19,7 @@ struct arr {
 
 	arr() = default;
 	arr(const arr &a) { *this = a; }
-	arr(arr &&a) { *this = mem::move(a); }
+	arr(arr &&a) noexcept { *this = mem::move(a); }
 	arr(std::initializer_list<T> list) {
 		reserve(list.size());
 		for (auto &&v : list) push(mem::move(v));
@@ -39,18 +41,27 @@ struct arr {
 	}
 
 	void reserve(usize new_cap) {
-		if (cap <= new_cap) {
+		if (cap < new_cap) {
 			reallocate(math::max(cap * 2, new_cap));
 		}
 	}
 
-	// resize without constructing the objects
+	// resize without constructing the objects, the new elements are uninitialised
 	void grow(usize new_len) {
 		reserve(new_len);
 		len = new_len;
 	}
 
 	void resize(usize new_len) {
+		if constexpr (std::is_trivial_v<T>) {
+			reserve(new_len);
+			if (new_len > len) {
+				memset(buf + len, 0, sizeof(T) * (new_len - len));
+			}
+			len = new_len;
+			return;
+		}
+
 		while (new_len < len) {
 			pop();
 		}
@@ -62,6 +73,15 @@ struct arr {
 	}
 
 	void resize(usize new_len, const T &value) {
+		if constexpr (std::is_trivially_copyable_v<T>) {
+			reserve(new_len);
+			for (usize i = len; i < new_len; ++i) {
+				buf[i] = value;
+			}
+			len = new_len;
+			return;
+		}
+
 		while (new_len < len) {
 			pop();
 		}
@@ -75,7 +95,7 @@ struct arr {
 	template<typename ...TArgs>
 	T &push(TArgs &&...args) {
 		reserve(len + 1);
-		mem::placementNew<T>(buf + len, mem::move(args)...);
+		mem::placementNew<T>(buf + len, mem::forward<TArgs>(args)...);
 		return buf[len++];
 	}
 
@@ -95,19 +115,31 @@ struct arr {
 		if (newcap < cap) {
 			newcap = cap * 2;
 		}
-		T *newbuf = (T *)pk_calloc(1, sizeof(T) * newcap);
-		pk_assert(newbuf);
-		for (usize i = 0; i < len; ++i) {
-			mem::placementNew<T>(newbuf + i, mem::move(buf[i]));
+
+		if constexpr (std::is_trivially_copyable_v<T>) {
+			// can be moved with a memcpy, so let realloc grow it in place if it can
+			T *newbuf = (T *)pk_realloc(buf, sizeof(T) * newcap);
+			pk_assert(newbuf);
+			buf = newbuf;
+		}
+		else {
+			T *newbuf = (T *)pk_malloc(sizeof(T) * newcap);
+			pk_assert(newbuf);
+			for (usize i = 0; i < len; ++i) {
+				mem::placementNew<T>(newbuf + i, mem::move(buf[i]));
+				buf[i].~T();
+			}
+			pk_free(buf);
+			buf = newbuf;
 		}
-		pk_free(buf);
-		buf = newbuf;
 		cap = newcap;
 	}
 
 	void clear() {
-		for (usize i = 0; i < len; ++i) {
-			buf[i].~T();
+		if constexpr (!std::is_trivially_destructible_v<T>) {
+			for (usize i = 0; i < len; ++i) {
+				buf[i].~T();
+			}
 		}
 		len = 0;
 	}
@@ -150,14 +182,22 @@ struct arr {
 		if (this != &a) {
 			clear();
 			reserve(a.len);
-			for (usize i = 0; i < a.len; ++i) {
-				push(a[i]);
+			if constexpr (std::is_trivially_copyable_v<T>) {
+				if (a.len) {
+					memcpy(buf, a.buf, sizeof(T) * a.len);
+				}
+				len = a.len;
+			}
+			else {
+				for (usize i = 0; i < a.len; ++i) {
+					push(a[i]);
+				}
 			}
 		}
 		return *this;
 	}
 
-	arr &operator=(arr &&a) {
+	arr &operator=(arr &&a) noexcept {
 		if (this != &a) {
 			mem::swap(buf, a.buf);
 			mem::swap(len, a.len);
@@ -49,10 +49,63 @@ using TCHAR = char;
 #define PK_RELEASE 1
 #endif
 
-#define pk_malloc(sz)        malloc(sz)
-#define pk_calloc(sz, count) calloc(sz, count)
-#define pk_realloc(ptr, sz)  realloc(ptr, sz)
-#define pk_free(ptr)         free(ptr)
+#ifndef PK_USE_TLSF
+#define PK_USE_TLSF 0
+#endif
+
+#ifndef PK_TRACK_ALLOCS
+#define PK_TRACK_ALLOCS 0
+#endif
+
+#if PK_USE_TLSF
+// std/heap.h, declared here so that every file doesn't need to include it
+namespace heap {
+    void *alloc(usize size);
+    void *calloc(usize size, usize count);
+    void *realloc(void *ptr, usize size);
+    void free(void *ptr);
+} // namespace heap
+
+#define pk__sys_malloc(sz)        ::heap::alloc(sz)
+#define pk__sys_calloc(sz, count) ::heap::calloc(sz, count)
+#define pk__sys_realloc(ptr, sz)  ::heap::realloc(ptr, sz)
+#define pk__sys_free(ptr)         ::heap::free(ptr)
+#else
+#define pk__sys_malloc(sz)        ::malloc(sz)
+#define pk__sys_calloc(sz, count) ::calloc(sz, count)
+#define pk__sys_realloc(ptr, sz)  ::realloc(ptr, sz)
+#define pk__sys_free(ptr)         ::free(ptr)
+#endif
+
+// subsystem that allocated the memory, see memtrack::TagScope
+enum class MemTag : u8 {
+    Std,
+    Formats,
+    Assets,
+    Gfx,
+    Jobs,
+    Count,
+};
+
+#if PK_TRACK_ALLOCS
+// std/memtrack.h, declared here so that every file doesn't need to include it
+namespace memtrack {
+    void *alloc(usize size);
+    void *calloc(usize size, usize count);
+    void *realloc(void *ptr, usize size);
+    void free(void *ptr);
+} // namespace memtrack
+
+#define pk_malloc(sz)        memtrack::alloc(sz)
+#define pk_calloc(sz, count) memtrack::calloc(sz, count)
+#define pk_realloc(ptr, sz)  memtrack::realloc(ptr, sz)
+#define pk_free(ptr)         memtrack::free(ptr)
+#else
+#define pk_malloc(sz)        pk__sys_malloc(sz)
+#define pk_calloc(sz, count) pk__sys_calloc(sz, count)
+#define pk_realloc(ptr, sz)  pk__sys_realloc(ptr, sz)
+#define pk_free(ptr)         pk__sys_free(ptr)
+#endif
 
 #define pk_assert(cond)      assert(cond)
 
@@ -1,60 +1,43 @@
 #pragma once
 
 #include <new>
+#include <type_traits>
 #include "mem.h"
 #include "arena.h"
+#include "pool.h"
 
 template <class T>
 constexpr T&& fwd(std::remove_reference_t<T>& arg) noexcept {
     return static_cast<T&&>(arg);
 }
 
-template<typename T>
-struct CallableBase;
-
-template<typename T, typename TRet, typename ...TArgs>
-struct Callable;
-
 template<typename T>
 struct Delegate;
 
 template<typename TRet, typename ...TArgs>
-struct CallableBase<TRet(TArgs...)> {
+struct Delegate<TRet(TArgs...)> {
     using Func = TRet(TArgs...);
 
-    CallableBase() = default;
-    virtual ~CallableBase() {}
-    virtual TRet invoke(TArgs &&...args) = 0;
-};
-
-template<typename T, typename TRet, typename ...TArgs>
-struct Callable<T, TRet(TArgs...)> : CallableBase<TRet(TArgs...)> {
-    T storage;
-
-    Callable() = default;
-    Callable(T &&storage) : storage(mem::move(storage)) {}
-
-    void init(T &&store) {
-        storage = mem::move(store);
-    }
-
-    TRet invoke(TArgs &&...args) {
-        return storage(mem::move(args)...);
-    }
-};
+    // lambdas up to this size are stored inside the delegate, bigger ones are allocated.
+    // captures need a noexcept move to be stored inline, like Str, arr and HashMap have
+    static constexpr usize kinline_size = 48;
 
-template<typename TRet, typename ...TArgs>
-struct Delegate<TRet(TArgs...)> {
-    using Func = TRet(TArgs...);
+    // what we need to know about the functor, one static table per type instead of a vtable
+    struct Ops {
+        TRet (*invoke)(void *functor, TArgs &&...args);
+        void (*destroy)(void *functor);
+        // move constructs src into dst and destroys src, only used for inline functors
+        void (*move)(void *dst, void *src);
+    };
 
     Delegate() = default;
     Delegate(Func *func_ptr) { init(func_ptr); }
+    template<typename T, typename = std::enable_if_t<!std::is_same_v<std::decay_t<T>, Delegate>>>
+    Delegate(T &&lambda) { init(mem::forward<T>(lambda)); }
     template<typename T>
-    Delegate(T &&lambda) { init(mem::move(lambda)); }
-    template<typename T>
-    Delegate(Arena &arena, T &&lambda) { init(arena, mem::move(lambda)); }
+    Delegate(Arena &arena, T &&lambda) { init(arena, mem::forward<T>(lambda)); }
 
-    Delegate(Delegate &&other) { *this = mem::move(other); }
+    Delegate(Delegate &&other) noexcept { *this = mem::move(other); }
 
     ~Delegate() { destroy(); }
 
@@ -62,62 +45,134 @@ struct Delegate<TRet(TArgs...)> {
         None         = 0,
         IsFunctor    = 1 << 0,
         IsArenaAlloc = 1 << 1,
+        IsInline     = 1 << 2,
     };
 
-    void *functor = nullptr;
-    // TODO can be put as two leftmost bit in functor ptr and then use mask
+    union {
+        void *functor = nullptr;
+        Func *func_ptr;
+        alignas(16) byte storage[kinline_size];
+    };
+    const Ops *ops = nullptr;
     Flags flags = None;
 
     void init(Func *func_ptr) {
-        functor = func_ptr;
+        destroy();
+        this->func_ptr = func_ptr;
     }
 
     template<typename T>
     void init(T &&lambda) {
-        static_assert(!std::is_function_v<T> && !std::is_member_function_pointer_v<T>);
-        
+        using Fn = std::decay_t<T>;
+        static_assert(!std::is_function_v<Fn> && !std::is_member_function_pointer_v<Fn>);
+
+        destroy();
+        ops = &ops_for<Fn>;
+        if constexpr (fitsInline<Fn>()) {
+            flags = (Flags)(IsFunctor | IsInline);
+            new (storage) Fn(mem::forward<T>(lambda));
+            return;
+        }
+
         flags = IsFunctor;
-        functor = pk_calloc(sizeof(Callable<T, Func>), 1);
-        // TODO figure out how to use custom placementNew here instead
-        new (functor) Callable<T, Func>(mem::forward<T>(lambda));
+        // too big to be stored inline, but most still fit in a pooled block
+        void *block = nullptr;
+        if constexpr (alignof(Fn) <= 16) {
+            block = mem::allocBlock(sizeof(Fn));
+        }
+        functor = block ? block : pk_malloc(sizeof(Fn));
+        new (functor) Fn(mem::forward<T>(lambda));
     }
 
     template<typename T>
     void init(Arena &arena, T &&lambda) {
-        static_assert(!std::is_function_v<T> && !std::is_member_function_pointer_v<T>);
-        
-        flags = IsFunctor | IsArenaAlloc;
-        functor = arena.alloc<Callable<T, Func>>();
-        // TODO figure out how to use custom placementNew here instead
-        new (functor) Callable<T, Func>(mem::forward<T>(lambda));
+        using Fn = std::decay_t<T>;
+        static_assert(!std::is_function_v<Fn> && !std::is_member_function_pointer_v<Fn>);
+
+        destroy();
+        ops = &ops_for<Fn>;
+        if constexpr (fitsInline<Fn>()) {
+            flags = (Flags)(IsFunctor | IsInline);
+            new (storage) Fn(mem::forward<T>(lambda));
+            return;
+        }
+
+        flags = (Flags)(IsFunctor | IsArenaAlloc);
+        functor = arena.alloc(sizeof(Fn), 1, alignof(Fn), Arena::NoZero);
+        new (functor) Fn(mem::forward<T>(lambda));
     }
 
     void destroy() {
-        if (flags & IsFunctor && !(flags & IsArenaAlloc)) {
-            CallableBase<Func> *call = (CallableBase<Func>*)functor;
-            call->~CallableBase();
-            pk_free(functor);
+        if (flags & IsFunctor) {
+            ops->destroy(getFunctor());
+            if (!(flags & (IsInline | IsArenaAlloc)) && !mem::freeBlock(functor)) {
+                pk_free(functor);
+            }
         }
         flags = None;
+        ops = nullptr;
         functor = nullptr;
     }
 
     operator bool() const {
-        return functor != nullptr;
+        return flags != None || func_ptr != nullptr;
     }
 
-    Delegate &operator=(Delegate &&other) {
-        if (this != &other) {
-            mem::swap(functor, other.functor);
-            mem::swap(flags, other.flags);
+    // inline functors are only stored if their move can't throw
+    Delegate &operator=(Delegate &&other) noexcept {
+        if (this == &other) {
+            return *this;
+        }
+
+        destroy();
+        if (other.flags & IsInline) {
+            other.ops->move(storage, other.storage);
+        }
+        else {
+            functor = other.functor;
         }
+        ops = other.ops;
+        flags = other.flags;
+
+        other.flags = None;
+        other.ops = nullptr;
+        other.functor = nullptr;
         return *this;
     }
 
     TRet operator()(TArgs ...args) {
         if (flags & IsFunctor) {
-            return ((CallableBase<Func> *)functor)->invoke(mem::move(args)...);
+            return ops->invoke(getFunctor(), mem::move(args)...);
         }
-        return ((Func *)functor)(mem::move(args)...);
+        return func_ptr(mem::move(args)...);
+    }
+
+private:
+    void *getFunctor() {
+        return flags & IsInline ? (void *)storage : functor;
     }
-};
\ No newline at end of file
+
+    template<typename Fn>
+    static constexpr bool fitsInline() {
+        return sizeof(Fn) <= kinline_size && alignof(Fn) <= 16 && std::is_nothrow_move_constructible_v<Fn>;
+    }
+
+    template<typename Fn>
+    static TRet invokeImpl(void *functor, TArgs &&...args) {
+        return (*(Fn *)functor)(mem::forward<TArgs>(args)...);
+    }
+
+    template<typename Fn>
+    static void destroyImpl(void *functor) {
+        ((Fn *)functor)->~Fn();
+    }
+
+    template<typename Fn>
+    static void moveImpl(void *dst, void *src) {
+        new (dst) Fn(mem::move(*(Fn *)src));
+        ((Fn *)src)->~Fn();
+    }
+
+    template<typename Fn>
+    static constexpr Ops ops_for = { &invokeImpl<Fn>, &destroyImpl<Fn>, &moveImpl<Fn> };
+};
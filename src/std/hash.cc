@@ -1,5 +1,11 @@
 #include "hash.h"
 
+#include <string.h>
+
+#if PK_WINDOWS
+#include <intrin.h>
+#endif
+
 u32 hashFnv132(const void *data, usize len) {
     constexpr u32 fnv_prime = 0x01000193u;
     constexpr u32 fnv_offset = 0x811c9dc5u;
@@ -28,11 +34,107 @@ u64 hashFnv164(const void *data, usize len) {
     return hash;
 }
 
-u32 hash_impl(const u32 &v) {
-    return hashFnv132(&v, sizeof(u32));
+// == WYHASH ===========================================================================================================
+
+// final version 4 of wyhash by Wang Yi, public domain. hash__secret is in the header,
+// it's shared with hashBytesConst
+
+// 64x64 -> 128 bit multiply, a gets the low half and b the high one
+static inline void hash__mum(u64 &a, u64 &b) {
+#if PK_WINDOWS
+    a = _umul128(a, b, &b);
+#else
+    __uint128_t r = (__uint128_t)a * b;
+    a = (u64)r;
+    b = (u64)(r >> 64);
+#endif
+}
+
+static inline u64 hash__mix(u64 a, u64 b) {
+    hash__mum(a, b);
+    return a ^ b;
+}
+
+static inline u64 hash__read8(const byte *p) {
+    u64 v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline u64 hash__read4(const byte *p) {
+    u32 v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// reads 1 to 3 bytes
+static inline u64 hash__read3(const byte *p, usize len) {
+    return ((u64)p[0] << 16) | ((u64)p[len >> 1] << 8) | p[len - 1];
 }
 
+u64 hashBytes(const void *data, usize len, u64 seed) {
+    const byte *p = (const byte *)data;
+    seed ^= hash__mix(seed ^ hash__secret[0], hash__secret[1]);
+    u64 a = 0, b = 0;
+
+    if (len <= 16) {
+        if (len >= 4) {
+            // two overlapping reads cover everything from 4 to 16 bytes
+            const usize mid = (len >> 3) << 2;
+            a = (hash__read4(p) << 32) | hash__read4(p + mid);
+            b = (hash__read4(p + len - 4) << 32) | hash__read4(p + len - 4 - mid);
+        }
+        else if (len > 0) {
+            a = hash__read3(p, len);
+        }
+    }
+    else {
+        usize i = len;
+        if (i >= 48) {
+            // three independent lanes so the multiplies can overlap
+            u64 see1 = seed, see2 = seed;
+            do {
+                seed = hash__mix(hash__read8(p)      ^ hash__secret[1], hash__read8(p + 8)  ^ seed);
+                see1 = hash__mix(hash__read8(p + 16) ^ hash__secret[2], hash__read8(p + 24) ^ see1);
+                see2 = hash__mix(hash__read8(p + 32) ^ hash__secret[3], hash__read8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i >= 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = hash__mix(hash__read8(p) ^ hash__secret[1], hash__read8(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        // the last 16 bytes, overlapping what was already hashed if needed
+        a = hash__read8(p + i - 16);
+        b = hash__read8(p + i - 8);
+    }
+
+    a ^= hash__secret[1];
+    b ^= seed;
+    hash__mum(a, b);
+    return hash__mix(a ^ hash__secret[0] ^ len, b ^ hash__secret[1]);
+}
+
+u64 hashInt(u64 value, u64 seed) {
+    u64 a = value ^ hash__secret[0];
+    u64 b = seed ^ hash__secret[1];
+    hash__mum(a, b);
+    return hash__mix(a ^ hash__secret[0], b ^ hash__secret[1]);
+}
+
+u64 hashCombine(u64 a, u64 b) {
+    return hash__mix(a ^ hash__secret[2], b ^ hash__secret[3]);
+}
+
+// == HASH IMPL ========================================================================================================
+
+u64 hash_impl(const u32 &v) {
+    return hashInt(v);
+}
 
-u32 hash_impl(const u64 &v) {
-    return hashFnv132(&v, sizeof(u64));
+u64 hash_impl(const u64 &v) {
+    return hashInt(v);
 }
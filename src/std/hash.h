@@ -3,4 +3,89 @@
 #include "common.h"
 
 u32 hashFnv132(const void *data, usize len);
-u64 hashFnv164(const void *data, usize len);
\ No newline at end of file
+u64 hashFnv164(const void *data, usize len);
+
+// wyhash, reads 8 to 48 bytes per step. this is what hash_impl uses for anything made of bytes
+u64 hashBytes(const void *data, usize len, u64 seed = 0);
+// mixes a single integer, much cheaper than hashing its bytes
+u64 hashInt(u64 value, u64 seed = 0);
+// combines two hashes, for keys made of multiple fields
+u64 hashCombine(u64 a, u64 b);
+// same result as hashBytes but it can run at compile time, at runtime it's a lot slower
+constexpr u64 hashBytesConst(const char *data, usize len, u64 seed = 0);
+
+u64 hash_impl(const u32 &v);
+u64 hash_impl(const u64 &v);
+
+// == CONSTEXPR WYHASH =================================================================================================
+
+inline constexpr u64 hash__secret[4] = {
+    0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull, 0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull,
+};
+
+// 64x64 -> 128 bit multiply out of 32 bit halves, there's no portable constexpr 128 bit type
+constexpr void hash__mum_const(u64 &a, u64 &b) {
+    const u64 ha = a >> 32, hb = b >> 32, la = (u32)a, lb = (u32)b;
+    const u64 rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    const u64 t = rl + (rm0 << 32);
+    u64 carry = t < rl;
+    const u64 lo = t + (rm1 << 32);
+    carry += lo < t;
+    a = lo;
+    b = rh + (rm0 >> 32) + (rm1 >> 32) + carry;
+}
+
+constexpr u64 hash__mix_const(u64 a, u64 b) {
+    hash__mum_const(a, b);
+    return a ^ b;
+}
+
+constexpr u64 hash__read_const(const char *p, usize count) {
+    u64 v = 0;
+    for (usize i = 0; i < count; ++i) {
+        v |= (u64)(u8)p[i] << (i * 8);
+    }
+    return v;
+}
+
+constexpr u64 hashBytesConst(const char *p, usize len, u64 seed) {
+    seed ^= hash__mix_const(seed ^ hash__secret[0], hash__secret[1]);
+    u64 a = 0, b = 0;
+
+    if (len <= 16) {
+        if (len >= 4) {
+            const usize mid = (len >> 3) << 2;
+            a = (hash__read_const(p, 4) << 32) | hash__read_const(p + mid, 4);
+            b = (hash__read_const(p + len - 4, 4) << 32) | hash__read_const(p + len - 4 - mid, 4);
+        }
+        else if (len > 0) {
+            a = ((u64)(u8)p[0] << 16) | ((u64)(u8)p[len >> 1] << 8) | (u8)p[len - 1];
+        }
+    }
+    else {
+        usize i = len;
+        if (i >= 48) {
+            u64 see1 = seed, see2 = seed;
+            do {
+                seed = hash__mix_const(hash__read_const(p, 8)      ^ hash__secret[1], hash__read_const(p + 8, 8)  ^ seed);
+                see1 = hash__mix_const(hash__read_const(p + 16, 8) ^ hash__secret[2], hash__read_const(p + 24, 8) ^ see1);
+                see2 = hash__mix_const(hash__read_const(p + 32, 8) ^ hash__secret[3], hash__read_const(p + 40, 8) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i >= 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = hash__mix_const(hash__read_const(p, 8) ^ hash__secret[1], hash__read_const(p + 8, 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = hash__read_const(p + i - 16, 8);
+        b = hash__read_const(p + i - 8, 8);
+    }
+
+    a ^= hash__secret[1];
+    b ^= seed;
+    hash__mum_const(a, b);
+    return hash__mix_const(a ^ hash__secret[0] ^ len, b ^ hash__secret[1]);
+}
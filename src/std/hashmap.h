@@ -1,179 +1,413 @@
 #pragma once
 
+#include <new>
+#include <string.h>
+
 #include "common.h"
-#include "arr.h"
+#include "mem.h"
+#include "maths.h"
+#include "hash.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PK_HASHMAP_SSE2 1
+#include <emmintrin.h>
+#else
+#define PK_HASHMAP_SSE2 0
+#endif
+
+#if PK_WINDOWS
+#include <intrin.h>
+#endif
+
+// open addressing hash map, SwissTable style. every slot has a control byte which is either
+// empty, deleted or the low 7 bits of the key's hash. the control bytes are checked a group
+// at a time and only the slots where those 7 bits match get their keys compared, so most
+// probes never touch the slots at all
+
+namespace hashmap__detail {
+	using ctrl_t = i8;
+
+	constexpr ctrl_t kempty   = -128; // 0b10000000
+	constexpr ctrl_t kdeleted = -2;   // 0b11111110
+
+	inline u32 ctz(u64 value) {
+#if PK_WINDOWS
+		unsigned long index;
+		_BitScanForward64(&index, value);
+		return (u32)index;
+#else
+		return (u32)__builtin_ctzll(value);
+#endif
+	}
+
+	// set bits of a group match, shift turns a bit index into a slot index
+	template<u32 shift>
+	struct BitMask {
+		u64 mask;
+
+		explicit operator bool() const { return mask != 0; }
+		u32 lowest() const { return ctz(mask) >> shift; }
+		void next() { mask &= mask - 1; }
+	};
+
+#if PK_HASHMAP_SSE2
+	struct Group {
+		static constexpr usize kwidth = 16;
+		using Mask = BitMask<0>;
 
-// TODO: if < X items, fallback to linear search and array
-// TODO: better api?
+		explicit Group(const ctrl_t *ctrl) : ctrl(_mm_loadu_si128((const __m128i *)ctrl)) {}
 
+		Mask match(u8 h2) const {
+			return { (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)h2))) };
+		}
+
+		Mask matchEmpty() const {
+			return { (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(kempty))) };
+		}
+
+		// both empty and deleted have the high bit set
+		Mask matchEmptyOrDeleted() const {
+			return { (u32)_mm_movemask_epi8(ctrl) };
+		}
+
+		Mask matchFull() const {
+			return { ~(u32)_mm_movemask_epi8(ctrl) & 0xFFFF };
+		}
+
+		__m128i ctrl;
+	};
+#else
+	// same thing on 8 bytes at a time in a u64, the matching bit is the top one of every byte
+	struct Group {
+		static constexpr usize kwidth = 8;
+		using Mask = BitMask<3>;
+
+		static constexpr u64 klsbs = 0x0101010101010101ull;
+		static constexpr u64 kmsbs = 0x8080808080808080ull;
+
+		explicit Group(const ctrl_t *ctrl) { memcpy(&word, ctrl, sizeof(word)); }
+
+		// can give false positives for full slots, those are filtered out by the key compare
+		Mask match(u8 h2) const {
+			u64 x = word ^ (klsbs * h2);
+			return { (x - klsbs) & ~x & kmsbs };
+		}
+
+		// empty is the only value with the high bit set and bit 1 cleared
+		Mask matchEmpty() const {
+			return { word & ~(word << 6) & kmsbs };
+		}
+
+		Mask matchEmptyOrDeleted() const {
+			return { word & kmsbs };
+		}
+
+		Mask matchFull() const {
+			return { ~word & kmsbs };
+		}
+
+		u64 word;
+	};
+#endif
+} // namespace hashmap__detail
+
+// keys are hashed with hash_impl and compared with ==. get, contains and remove also take any
+// type that hashes and compares the same as Key, like a Str when Key is a StrView.
+// pointers to values are invalidated when the map grows
 template<typename Key, typename Value>
 struct HashMap {
-	HashMap() {
-		reserve(64);
+	using ctrl_t = hashmap__detail::ctrl_t;
+	using Group = hashmap__detail::Group;
+
+	struct Slot {
+		Key key;
+		Value value;
+	};
+
+	// grows once it's 7/8 full
+	static constexpr usize kmax_load_num = 7;
+	static constexpr usize kmax_load_den = 8;
+
+	HashMap() = default;
+	HashMap(const HashMap &other) { *this = other; }
+	HashMap(HashMap &&other) noexcept { *this = mem::move(other); }
+	~HashMap() { destroy(); }
+
+	HashMap &operator=(const HashMap &other) {
+		if (this != &other) {
+			clear();
+			reserve(other.count);
+			for (auto it = other.begin(); it != other.end(); ++it) {
+				push(it.key(), *it);
+			}
+		}
+		return *this;
 	}
 
-	void setTombstone(const Key &new_tomb) {
-		tombstone = new_tomb;
+	HashMap &operator=(HashMap &&other) noexcept {
+		if (this != &other) {
+			mem::swap(ctrl, other.ctrl);
+			mem::swap(slots, other.slots);
+			mem::swap(cap, other.cap);
+			mem::swap(count, other.count);
+			mem::swap(growth_left, other.growth_left);
+		}
+		return *this;
 	}
 
-	void setTombstone(Key &&new_tomb) {
-		tombstone = mem::move(new_tomb);
+	void destroy() {
+		clear();
+		pk_free(ctrl);
+		ctrl = nullptr;
+		slots = nullptr;
+		cap = growth_left = 0;
 	}
-	
+
+	void clear() {
+		if (!cap) return;
+		for (usize i = 0; i < cap; ++i) {
+			if (ctrl[i] >= 0) {
+				slots[i].~Slot();
+			}
+		}
+		memset(ctrl, (u8)hashmap__detail::kempty, cap);
+		count = 0;
+		growth_left = maxLoad(cap);
+	}
+
+	// makes sure n items can be pushed without rehashing
 	void reserve(usize n) {
-		usize next_pow2 = n;
-		
-        // find next power of two
-        next_pow2--;
-        next_pow2 |= next_pow2 >> 1;
-        next_pow2 |= next_pow2 >> 2;
-        next_pow2 |= next_pow2 >> 4;
-        next_pow2 |= next_pow2 >> 8;
-        next_pow2 |= next_pow2 >> 16;
-        next_pow2++;
-
-		keys.clear();
-		keys.resize(next_pow2, tombstone);
-		values.resize(next_pow2);
+		usize new_cap = Group::kwidth;
+		while (maxLoad(new_cap) < n) {
+			new_cap *= 2;
+		}
+		if (new_cap > cap) {
+			rehash(new_cap);
+		}
+	}
+
+	// moves everything to a new table, this also gets rid of the deleted slots
+	void rehash(usize new_cap) {
+		pk_assert(new_cap >= Group::kwidth && (new_cap & (new_cap - 1)) == 0);
+		pk_assert(maxLoad(new_cap) >= count);
+
+		ctrl_t *old_ctrl = ctrl;
+		Slot *old_slots = slots;
+		usize old_cap = cap;
+
+		const usize slots_offset = slotsOffset(new_cap);
+		byte *block = (byte *)pk_malloc(slots_offset + sizeof(Slot) * new_cap);
+		pk_assert(block);
+		ctrl = (ctrl_t *)block;
+		slots = (Slot *)(block + slots_offset);
+		cap = new_cap;
+		growth_left = maxLoad(new_cap) - count;
+		memset(ctrl, (u8)hashmap__detail::kempty, cap);
+
+		for (usize i = 0; i < old_cap; ++i) {
+			if (old_ctrl[i] < 0) continue;
+			const u64 hash = hash_impl(old_slots[i].key);
+			const usize index = findFree(hash);
+			ctrl[index] = h2(hash);
+			new (&slots[index]) Slot(mem::move(old_slots[i]));
+			old_slots[i].~Slot();
+		}
+
+		pk_free(old_ctrl);
 	}
 
+	// adds the key if it's not in the map yet, otherwise overwrites its value
 	Value *push(const Key &key, const Value &value = {}) {
-		//Value &val = pushImpl(key, key.hash());
-		Value &val = pushImpl(key, hash_impl(key));
+		Value &val = pushImpl(key);
 		val = value;
 		return &val;
-#if 0
-		usize pos = keys.find(key);
-		if (pos == SIZE_MAX) {
-			keys.push(key);
-			return &values.push(value);
-		}
-		else {
-			values[pos] = value;
-			return &values[pos];
-		}
-#endif
 	}
 
-	Value* push(const Key &key, Value &&value) {
-		//Value &val = pushImpl(key, key.hash());
-		Value &val = pushImpl(key, hash_impl(key));
+	Value *push(const Key &key, Value &&value) {
+		Value &val = pushImpl(key);
 		val = mem::move(value);
 		return &val;
-#if 0
-		usize pos = keys.find(key);
-		if (pos == SIZE_MAX) {
-			keys.push(key);
-			return &values.push(mem::move(value));
+	}
+
+	template<typename K>
+	Value *get(const K &key) {
+		usize index = find(key, hash_impl(key));
+		return index != knot_found ? &slots[index].value : nullptr;
+	}
+
+	template<typename K>
+	const Value *get(const K &key) const {
+		usize index = find(key, hash_impl(key));
+		return index != knot_found ? &slots[index].value : nullptr;
+	}
+
+	template<typename K>
+	bool contains(const K &key) const {
+		return find(key, hash_impl(key)) != knot_found;
+	}
+
+	// returns false if the key wasn't there
+	template<typename K>
+	bool remove(const K &key) {
+		usize index = find(key, hash_impl(key));
+		if (index == knot_found) {
+			return false;
+		}
+
+		slots[index].~Slot();
+		--count;
+
+		// if the group still has an empty slot no probe ever went past it, so there's no
+		// chain to keep alive and the slot can go back to being empty
+		const usize group_start = index & ~(Group::kwidth - 1);
+		if (Group(ctrl + group_start).matchEmpty()) {
+			ctrl[index] = hashmap__detail::kempty;
+			++growth_left;
 		}
 		else {
-			values[pos] = mem::move(value);
-			return &values[pos];
+			ctrl[index] = hashmap__detail::kdeleted;
 		}
-#endif
+
+		return true;
 	}
 
-	Value *get(const Key& key) {
-		u32 hash = hash_impl(key) & ((u32)keys.size() - 1);
-		//u32 hash = key.hash() & ((u32)keys.size() - 1);
-
-        // maximum number of iterations
-        for (usize i = 0; i < keys.size(); ++i) {
-            // unique, doesn't exist
-            if (keys[hash] == tombstone) {
-				return nullptr;
-            }
-            
-            // found it!
-            if (keys[hash] == key) {
-                return &values[hash];
-            }
-
-            // theres something, but not what we're looking for,
-			// linear probe
-            hash = (hash + 1) & (u32)(keys.size() - 1);
-        }
-
-		return nullptr;
-#if 0
-		usize pos = keys.find(key);
-		if (pos == SIZE_MAX) {
-			return nullptr;
-		}
-		else {
-			return &values[pos];
+	bool empty() const { return count == 0; }
+	usize size() const { return count; }
+	usize capacity() const { return cap; }
+	float loadFactor() const { return cap ? (float)count / (float)cap : 0.f; }
+
+	template<typename TMap, typename TValue>
+	struct IterBase {
+		IterBase(TMap *map, usize index) : map(map), cur_index(index) {}
+
+		TValue &operator*() const { return map->slots[cur_index].value; }
+		TValue *operator->() const { return &map->slots[cur_index].value; }
+		const Key &key() const { return map->slots[cur_index].key; }
+
+		IterBase &operator++() {
+			cur_index = map->nextFull(cur_index + 1);
+			return *this;
 		}
-#endif
+
+		bool operator==(const IterBase &other) const { return cur_index == other.cur_index; }
+		bool operator!=(const IterBase &other) const { return cur_index != other.cur_index; }
+
+		TMap *map;
+		usize cur_index = 0;
+	};
+
+	using HashIter = IterBase<HashMap, Value>;
+	using ConstHashIter = IterBase<const HashMap, const Value>;
+
+	HashIter begin() { return HashIter(this, nextFull(0)); }
+	HashIter end() { return HashIter(this, cap); }
+	ConstHashIter begin() const { return ConstHashIter(this, nextFull(0)); }
+	ConstHashIter end() const { return ConstHashIter(this, cap); }
+
+private:
+	static constexpr usize knot_found = SIZE_MAX;
+
+	static usize maxLoad(usize capacity) {
+		return capacity / kmax_load_den * kmax_load_num;
 	}
 
-	struct HashIter {
-		HashIter(HashMap &map, usize index) : map(map), cur_index(index) {}
+	static usize slotsOffset(usize capacity) {
+		return (capacity + alignof(Slot) - 1) & ~(alignof(Slot) - 1);
+	}
+
+	static u8 h2(u64 hash) { return (u8)(hash & 0x7F); }
+	static usize h1(u64 hash) { return (usize)(hash >> 7); }
+
+	// probes whole groups, jumping 1, 2, 3... groups ahead every time. with a power of two
+	// number of groups this visits all of them
+	template<typename K>
+	usize find(const K &key, u64 hash) const {
+		if (!cap) {
+			return knot_found;
+		}
 
-		Value &operator*() { return map.values[cur_index]; }
-		Value *operator->() { return &map.values[cur_index]; }
+		const usize group_mask = cap / Group::kwidth - 1;
+		usize group = h1(hash) & group_mask;
 
-		const Value &operator*() const { return map.values[cur_index]; }
-		const Value *operator->() const { return &map.values[cur_index]; }
+		for (usize step = 1; step <= group_mask + 1; ++step) {
+			const usize base = group * Group::kwidth;
+			Group g(ctrl + base);
 
-		HashIter &operator++() {
-			for (++cur_index; cur_index < map.keys.size(); ++cur_index) {
-				if (map.keys[cur_index] != map.tombstone) {
-					break;
+			for (auto match = g.match(h2(hash)); match; match.next()) {
+				const usize index = base + match.lowest();
+				if (slots[index].key == key) {
+					return index;
 				}
 			}
 
-			return *this;
+			// an empty slot means the key would have been put here
+			if (g.matchEmpty()) {
+				return knot_found;
+			}
+
+			group = (group + step) & group_mask;
 		}
 
-		bool operator==(const HashIter &other) const {
-			return cur_index == other.cur_index;
+		return knot_found;
+	}
+
+	usize findFree(u64 hash) const {
+		const usize group_mask = cap / Group::kwidth - 1;
+		usize group = h1(hash) & group_mask;
+
+		for (usize step = 1; step <= group_mask + 1; ++step) {
+			const usize base = group * Group::kwidth;
+			if (auto match = Group(ctrl + base).matchEmptyOrDeleted()) {
+				return base + match.lowest();
+			}
+			group = (group + step) & group_mask;
 		}
 
-		bool operator!=(const HashIter &other) const {
-			return cur_index != other.cur_index;
+		// the load factor makes sure there's always a free slot
+		pk_assert(false);
+		return knot_found;
+	}
+
+	usize nextFull(usize index) const {
+		while (index < cap && ctrl[index] < 0) {
+			++index;
 		}
+		return index < cap ? index : cap;
+	}
 
-		HashMap &map;
-		usize cur_index = 0;
-	};
+	Value &pushImpl(const Key &key) {
+		u64 hash = hash_impl(key);
+		usize index = find(key, hash);
+		if (index != knot_found) {
+			return slots[index].value;
+		}
+
+		if (cap) {
+			index = findFree(hash);
+		}
 
-	HashIter begin() { return HashIter(*this, 0); }
-	HashIter end() { return HashIter(*this, keys.size()); }
-	const HashIter begin() const { return HashIter(*this, 0); }
-	const HashIter end() const { return HashIter(*this, keys.size()); }
+		// deleted slots can be reused without using up more of the table
+		if (!cap || (ctrl[index] == hashmap__detail::kempty && growth_left == 0)) {
+			// if it's mostly deleted slots it's enough to clean them up
+			const bool mostly_deleted = cap && count < maxLoad(cap) / 2;
+			rehash(mostly_deleted ? cap : math::max(cap * 2, Group::kwidth));
+			index = findFree(hash);
+		}
 
-private:
-	Value &pushImpl(const Key &key, u32 hash) {
-		// u32 hash = key.hash() & ((u32)keys.size() - 1);
-		hash &= (u32)keys.size() - 1;
-
-        // maximum number of iterations
-        for (usize i = 0; i < keys.size(); ++i) {
-            // unique
-            if (keys[hash] == tombstone) {
-                keys[hash] = key;
-                return values[hash];
-            }
-            
-            // not unique
-            if (keys[hash] == key) {
-                return values[hash];
-            }
-
-            // linear probe
-            hash = (hash + 1) & (u32)(keys.size() - 1);
-        }
-
-		// new item and no empty spots, lets resize
-		usize old_len = keys.len;
-		keys.resize(old_len * 2);
-		values.resize(old_len * 2);
-
-		// TODO avoid stack overflow
-		return pushImpl(key, hash);
-	}
-
-	arr<Key> keys;
-	arr<Value> values;
-	Key tombstone = {};
-};
\ No newline at end of file
+		if (ctrl[index] == hashmap__detail::kempty) {
+			--growth_left;
+		}
+
+		ctrl[index] = h2(hash);
+		new (&slots[index].key) Key(key);
+		new (&slots[index].value) Value();
+		++count;
+		return slots[index].value;
+	}
+
+	ctrl_t *ctrl = nullptr;
+	Slot *slots = nullptr;
+	usize cap = 0;
+	usize count = 0;
+	usize growth_left = 0;
+};
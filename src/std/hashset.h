@@ -30,15 +30,15 @@ struct HashSet {
 
     // returns true if unique
     bool push(const T &key) {
-        extern u32 hash_impl(const T &);
+        extern u64 hash_impl(const T &);
 
         return pushImpl(key, hash_impl(key));
     }
 
     bool has(const T &key) const {
-        extern u32 hash_impl(const T &);
+        extern u64 hash_impl(const T &);
 
-        u32 hash = hash_impl(key) & ((u32)values.len - 1);
+        u32 hash = (u32)hash_impl(key) & ((u32)values.len - 1);
 
         // maximum number of iterations
         for (usize i = 0; i < values.len; ++i) {
@@ -62,9 +62,9 @@ struct HashSet {
 
     // return false if item wasn't in hash set
     bool remove(const T &key) {
-        extern u32 hash_impl(const T &);
+        extern u64 hash_impl(const T &);
 
-        u32 hash = hash_impl(key) & ((u32)values.len - 1);
+        u32 hash = (u32)hash_impl(key) & ((u32)values.len - 1);
         // maximum number of iterations
         for (usize i = 0; i < values.len; ++i) {
             // doesn't exist
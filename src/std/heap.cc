@@ -0,0 +1,558 @@
+#include "heap.h"
+
+#include <atomic>
+#include <stddef.h> // offsetof
+#include <string.h>
+
+#include "vmem.h"
+#include "arena.h"
+
+#if PK_WINDOWS
+#include <intrin.h>
+#endif
+
+// free blocks are kept in lists indexed by the highest bit of their size (first level) and
+// the heap__sl_log bits after it (second level). a bitmap for each level means finding
+// a list with a big enough block is just a couple of bit scans.
+// small sizes (less than heap__small_size) all go in the first list, split linearly
+
+static constexpr u32   heap__align_log  = 4;
+static constexpr usize heap__align      = 1ull << heap__align_log;
+static constexpr u32   heap__sl_log     = 5;
+static constexpr u32   heap__sl_count   = 1u << heap__sl_log;
+static constexpr u32   heap__fl_shift   = heap__sl_log + heap__align_log;
+static constexpr u32   heap__fl_max     = 40;
+static constexpr u32   heap__fl_count   = heap__fl_max - heap__fl_shift + 1;
+static constexpr usize heap__small_size = 1ull << heap__fl_shift;
+// leave room for the rounding up done when searching
+static constexpr usize heap__max_alloc  = 1ull << (heap__fl_max - 2);
+
+static constexpr usize heap__reserve    = gb(16);
+static constexpr usize heap__chunk      = mb(1);
+static constexpr u32   heap__max_heaps  = 256;
+// remote frees handled by each allocation, the rest wait for the next one so alloc stays bounded
+static constexpr u32   heap__max_drain  = 32;
+
+// block header, prev_phys is only valid when the previous block is free
+struct heap__block {
+    heap__block *prev_phys;
+    // size | flags | owner heap index << heap__owner_shift
+    usize header;
+    // only in free blocks, they overlap with the user memory
+    heap__block *next_free;
+    heap__block *prev_free;
+};
+
+static constexpr usize heap__overhead    = offsetof(heap__block, next_free);
+static constexpr usize heap__min_size    = sizeof(heap__block) - heap__overhead;
+static constexpr usize heap__is_free     = 1 << 0;
+static constexpr usize heap__prev_free   = 1 << 1;
+static constexpr usize heap__owner_shift = 48;
+static constexpr usize heap__size_mask   = ((1ull << heap__owner_shift) - 1) & ~(heap__align - 1);
+
+struct heap__heap {
+    u32 fl_bitmap;
+    u32 sl_bitmap[heap__fl_count];
+    heap__block *free_lists[heap__fl_count][heap__sl_count];
+
+    byte *start;
+    byte *committed;
+    byte *end;
+    // zero sized used block at the end of the committed memory
+    heap__block *sentinel;
+    // memory freed by other threads, linked through the first bytes of each allocation
+    std::atomic<void *> remote_frees;
+    // remote frees already taken by the owner, but not freed yet
+    void *pending_frees;
+    u16 index;
+
+    // only written by the owner, atomic so getStats can read them from any thread
+    std::atomic<usize> used;
+    std::atomic<usize> peak;
+    std::atomic<u64> alloc_count;
+    std::atomic<u64> free_count;
+};
+
+// zero initialised, so it's ready before any static constructor calls pk_malloc
+static heap__heap heap__heaps[heap__max_heaps];
+static u32 heap__heap_count = 1;
+static u16 heap__abandoned[heap__max_heaps];
+static u32 heap__abandoned_count = 0;
+static std::atomic_flag heap__lock = ATOMIC_FLAG_INIT;
+
+// heap shared between the threads that don't have their own, protected by heap__shared_lock
+static heap__heap *heap__shared = nullptr;
+static std::atomic_flag heap__shared_lock = ATOMIC_FLAG_INIT;
+
+static thread_local heap__heap *heap__local = nullptr;
+static thread_local bool heap__thread_exited = false;
+
+struct heap__thread_guard {
+    ~heap__thread_guard();
+};
+static thread_local heap__thread_guard heap__guard;
+
+// == BITS =============================================================================================================
+
+static u32 heap__fls(usize value) {
+#if PK_WINDOWS
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return (u32)index;
+#else
+    return 63 - (u32)__builtin_clzll(value);
+#endif
+}
+
+static u32 heap__ffs(u32 value) {
+#if PK_WINDOWS
+    unsigned long index;
+    _BitScanForward(&index, value);
+    return (u32)index;
+#else
+    return (u32)__builtin_ctz(value);
+#endif
+}
+
+static void heap__spin_lock(std::atomic_flag &flag) {
+    while (flag.test_and_set(std::memory_order_acquire)) {
+    }
+}
+
+static void heap__spin_unlock(std::atomic_flag &flag) {
+    flag.clear(std::memory_order_release);
+}
+
+// == BLOCKS ===========================================================================================================
+
+static usize heap__size(const heap__block *block) {
+    return block->header & heap__size_mask;
+}
+
+static void heap__set_size(heap__block *block, usize size) {
+    block->header = (block->header & ~heap__size_mask) | size;
+}
+
+static u32 heap__owner(const heap__block *block) {
+    return (u32)(block->header >> heap__owner_shift);
+}
+
+static heap__block *heap__from_ptr(const void *ptr) {
+    return (heap__block *)((byte *)ptr - heap__overhead);
+}
+
+static void *heap__to_ptr(heap__block *block) {
+    return (byte *)block + heap__overhead;
+}
+
+static heap__block *heap__next_phys(heap__block *block) {
+    return (heap__block *)((byte *)block + heap__overhead + heap__size(block));
+}
+
+static void heap__mapping_insert(usize size, u32 &fl, u32 &sl) {
+    if (size < heap__small_size) {
+        fl = 0;
+        sl = (u32)(size >> heap__align_log);
+    }
+    else {
+        u32 bit = heap__fls(size);
+        sl = (u32)(size >> (bit - heap__sl_log)) ^ heap__sl_count;
+        fl = bit - heap__fl_shift + 1;
+    }
+}
+
+// any block at least this big is in a list heap__find_free looks at for size
+static usize heap__search_size(usize size) {
+    if (size >= heap__small_size) {
+        size += (1ull << (heap__fls(size) - heap__sl_log)) - 1;
+    }
+    return size;
+}
+
+// rounds up to the next list, so that any block in it is big enough
+static void heap__mapping_search(usize size, u32 &fl, u32 &sl) {
+    heap__mapping_insert(heap__search_size(size), fl, sl);
+}
+
+static void heap__insert_free(heap__heap &h, heap__block *block) {
+    u32 fl, sl;
+    heap__mapping_insert(heap__size(block), fl, sl);
+
+    heap__block *head = h.free_lists[fl][sl];
+    block->next_free = head;
+    block->prev_free = nullptr;
+    if (head) {
+        head->prev_free = block;
+    }
+    h.free_lists[fl][sl] = block;
+    h.fl_bitmap |= 1u << fl;
+    h.sl_bitmap[fl] |= 1u << sl;
+}
+
+static void heap__remove_free(heap__heap &h, heap__block *block) {
+    u32 fl, sl;
+    heap__mapping_insert(heap__size(block), fl, sl);
+
+    if (block->prev_free) block->prev_free->next_free = block->next_free;
+    if (block->next_free) block->next_free->prev_free = block->prev_free;
+
+    if (h.free_lists[fl][sl] == block) {
+        h.free_lists[fl][sl] = block->next_free;
+        if (!block->next_free) {
+            h.sl_bitmap[fl] &= ~(1u << sl);
+            if (!h.sl_bitmap[fl]) {
+                h.fl_bitmap &= ~(1u << fl);
+            }
+        }
+    }
+}
+
+static heap__block *heap__find_free(heap__heap &h, usize size) {
+    u32 fl, sl;
+    heap__mapping_search(size, fl, sl);
+
+    u32 sl_map = h.sl_bitmap[fl] & (~0u << sl);
+    if (!sl_map) {
+        u32 fl_map = fl + 1 < 32 ? h.fl_bitmap & (~0u << (fl + 1)) : 0;
+        if (!fl_map) {
+            return nullptr;
+        }
+        fl = heap__ffs(fl_map);
+        sl_map = h.sl_bitmap[fl];
+    }
+    sl = heap__ffs(sl_map);
+    return h.free_lists[fl][sl];
+}
+
+// the block has to be already out of the free lists
+static void heap__use(heap__heap &h, heap__block *block, usize size) {
+    usize remaining = heap__size(block) - size;
+    heap__block *next = nullptr;
+
+    if (remaining >= heap__overhead + heap__min_size) {
+        heap__set_size(block, size);
+        heap__block *rest = heap__next_phys(block);
+        rest->header = (remaining - heap__overhead) | heap__is_free | ((usize)h.index << heap__owner_shift);
+        next = heap__next_phys(rest);
+        next->prev_phys = rest;
+        next->header |= heap__prev_free;
+        heap__insert_free(h, rest);
+    }
+    else {
+        next = heap__next_phys(block);
+        next->header &= ~heap__prev_free;
+    }
+
+    block->header &= ~heap__is_free;
+}
+
+static bool heap__grow(heap__heap &h, usize size) {
+    if (!h.start) {
+        usize reserved = 0;
+        h.start = (byte *)vmem::init(heap__reserve, &reserved);
+        if (!h.start) {
+            return false;
+        }
+        h.committed = h.start;
+        h.end = h.start + reserved;
+    }
+
+    // room for the new block and the new sentinel
+    usize needed = size + heap__overhead * 2;
+    usize grow_size = ((needed + heap__chunk - 1) / heap__chunk) * heap__chunk;
+    if (grow_size > (usize)(h.end - h.committed)) {
+        return false;
+    }
+    if (!vmem::commit(h.committed, grow_size / vmem::getPageSize())) {
+        return false;
+    }
+
+    // the old sentinel becomes the header of the new block, so the heap stays one contiguous list
+    heap__block *block = h.sentinel ? h.sentinel : (heap__block *)h.start;
+    byte *new_end = h.committed + grow_size;
+    h.committed = new_end;
+
+    heap__block *sentinel = (heap__block *)(new_end - heap__overhead);
+    usize block_size = (byte *)sentinel - (byte *)block - heap__overhead;
+    usize prev_free = h.sentinel ? (h.sentinel->header & heap__prev_free) : 0;
+    block->header = block_size | heap__is_free | prev_free | ((usize)h.index << heap__owner_shift);
+
+    sentinel->prev_phys = block;
+    sentinel->header = heap__prev_free | ((usize)h.index << heap__owner_shift);
+    h.sentinel = sentinel;
+
+    if (prev_free) {
+        heap__block *prev = block->prev_phys;
+        heap__remove_free(h, prev);
+        heap__set_size(prev, heap__size(prev) + heap__overhead + block_size);
+        sentinel->prev_phys = prev;
+        block = prev;
+    }
+    heap__insert_free(h, block);
+    return true;
+}
+
+static usize heap__adjust_size(usize size) {
+    size = (size + heap__align - 1) & ~(heap__align - 1);
+    return size < heap__min_size ? heap__min_size : size;
+}
+
+static void heap__free_block(heap__heap &h, heap__block *block) {
+    usize size = heap__size(block);
+    h.used.store(h.used.load(std::memory_order_relaxed) - size, std::memory_order_relaxed);
+    h.free_count.store(h.free_count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+    block->header |= heap__is_free;
+
+    if (block->header & heap__prev_free) {
+        heap__block *prev = block->prev_phys;
+        heap__remove_free(h, prev);
+        heap__set_size(prev, heap__size(prev) + heap__overhead + size);
+        block = prev;
+    }
+
+    heap__block *next = heap__next_phys(block);
+    if (next->header & heap__is_free) {
+        heap__remove_free(h, next);
+        heap__set_size(block, heap__size(block) + heap__overhead + heap__size(next));
+        next = heap__next_phys(block);
+    }
+
+    next->prev_phys = block;
+    next->header |= heap__prev_free;
+    heap__insert_free(h, block);
+}
+
+// frees at most max_count of the blocks other threads gave back
+static void heap__drain_remote(heap__heap &h, u32 max_count) {
+    if (!h.pending_frees) {
+        h.pending_frees = h.remote_frees.exchange(nullptr, std::memory_order_acquire);
+    }
+
+    void *ptr = h.pending_frees;
+    for (u32 i = 0; ptr && i < max_count; ++i) {
+        void *next = *(void **)ptr;
+        heap__free_block(h, heap__from_ptr(ptr));
+        ptr = next;
+    }
+    h.pending_frees = ptr;
+}
+
+static bool heap__has_remote(const heap__heap &h) {
+    return h.pending_frees || h.remote_frees.load(std::memory_order_relaxed);
+}
+
+static void *heap__alloc_from(heap__heap &h, usize size) {
+    if (heap__has_remote(h)) {
+        heap__drain_remote(h, heap__max_drain);
+    }
+
+    if (size > heap__max_alloc) {
+        return nullptr;
+    }
+    size = heap__adjust_size(size);
+
+    heap__block *block = heap__find_free(h, size);
+    if (!block) {
+        // the search rounds up to the next list, the new block has to be big enough to be in it
+        if (!heap__grow(h, heap__search_size(size))) {
+            return nullptr;
+        }
+        block = heap__find_free(h, size);
+        if (!block) {
+            return nullptr;
+        }
+    }
+
+    heap__remove_free(h, block);
+    heap__use(h, block, size);
+
+    usize used = h.used.load(std::memory_order_relaxed) + heap__size(block);
+    h.used.store(used, std::memory_order_relaxed);
+    if (used > h.peak.load(std::memory_order_relaxed)) {
+        h.peak.store(used, std::memory_order_relaxed);
+    }
+    h.alloc_count.store(h.alloc_count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+    return heap__to_ptr(block);
+}
+
+// tries to make the block big enough by taking memory from the next one
+static bool heap__expand(heap__heap &h, heap__block *block, usize size) {
+    heap__block *next = heap__next_phys(block);
+    usize old_size = heap__size(block);
+    if (!(next->header & heap__is_free) || old_size + heap__overhead + heap__size(next) < size) {
+        return false;
+    }
+
+    heap__remove_free(h, next);
+    heap__set_size(block, old_size + heap__overhead + heap__size(next));
+    heap__use(h, block, size);
+
+    usize used = h.used.load(std::memory_order_relaxed) + heap__size(block) - old_size;
+    h.used.store(used, std::memory_order_relaxed);
+    if (used > h.peak.load(std::memory_order_relaxed)) {
+        h.peak.store(used, std::memory_order_relaxed);
+    }
+    return true;
+}
+
+// == THREAD HEAPS =====================================================================================================
+
+static heap__heap *heap__acquire() {
+    heap__spin_lock(heap__lock);
+
+    heap__heap *h = nullptr;
+    if (heap__abandoned_count > 0) {
+        h = &heap__heaps[heap__abandoned[--heap__abandoned_count]];
+    }
+    else if (heap__heap_count < heap__max_heaps) {
+        h = &heap__heaps[heap__heap_count];
+        h->index = (u16)heap__heap_count++;
+    }
+
+    heap__spin_unlock(heap__lock);
+    return h;
+}
+
+static void heap__abandon(heap__heap *h) {
+    heap__spin_lock(heap__lock);
+    heap__abandoned[heap__abandoned_count++] = h->index;
+    heap__spin_unlock(heap__lock);
+}
+
+heap__thread_guard::~heap__thread_guard() {
+    // the heap is kept alive as other threads might still be using its memory,
+    // the next thread that needs one takes it over
+    if (heap__local) {
+        while (heap__has_remote(*heap__local)) {
+            heap__drain_remote(*heap__local, UINT32_MAX);
+        }
+        heap__abandon(heap__local);
+        heap__local = nullptr;
+    }
+    heap__thread_exited = true;
+}
+
+// returns null if the thread has to use the shared heap
+static heap__heap *heap__get_local() {
+    if (heap__local) {
+        return heap__local;
+    }
+    // thread local destructors can still allocate once the thread's heap is gone
+    if (heap__thread_exited) {
+        return nullptr;
+    }
+
+    // using the guard makes sure its destructor runs when the thread exits
+    (void)&heap__guard;
+    heap__local = heap__acquire();
+    return heap__local;
+}
+
+static void *heap__alloc_shared(usize size) {
+    heap__spin_lock(heap__shared_lock);
+    if (!heap__shared) {
+        heap__shared = heap__acquire();
+    }
+    void *ptr = heap__shared ? heap__alloc_from(*heap__shared, size) : nullptr;
+    heap__spin_unlock(heap__shared_lock);
+    return ptr;
+}
+
+namespace heap {
+    void *alloc(usize size) {
+        if (heap__heap *h = heap__get_local()) {
+            return heap__alloc_from(*h, size);
+        }
+        return heap__alloc_shared(size);
+    }
+
+    void *calloc(usize size, usize count) {
+        usize total = size * count;
+        if (count && total / count != size) {
+            return nullptr;
+        }
+        void *ptr = alloc(total);
+        return ptr ? memset(ptr, 0, total) : nullptr;
+    }
+
+    void *realloc(void *ptr, usize size) {
+        if (!ptr) {
+            return alloc(size);
+        }
+        if (size == 0) {
+            free(ptr);
+            return nullptr;
+        }
+
+        heap__block *block = heap__from_ptr(ptr);
+        usize old_size = heap__size(block);
+        if (size <= old_size) {
+            return ptr;
+        }
+
+        heap__heap *local = heap__get_local();
+        if (local && local->index == heap__owner(block) && size <= heap__max_alloc) {
+            if (heap__expand(*local, block, heap__adjust_size(size))) {
+                return ptr;
+            }
+        }
+
+        void *new_ptr = alloc(size);
+        if (new_ptr) {
+            memcpy(new_ptr, ptr, old_size);
+            free(ptr);
+        }
+        return new_ptr;
+    }
+
+    void free(void *ptr) {
+        if (!ptr) {
+            return;
+        }
+
+        heap__block *block = heap__from_ptr(ptr);
+        heap__heap &owner = heap__heaps[heap__owner(block)];
+
+        if (&owner == heap__local) {
+            heap__free_block(owner, block);
+        }
+        else if (&owner == heap__shared) {
+            heap__spin_lock(heap__shared_lock);
+            heap__free_block(owner, block);
+            heap__spin_unlock(heap__shared_lock);
+        }
+        else {
+            // the owner frees it the next time it allocates
+            void *head = owner.remote_frees.load(std::memory_order_relaxed);
+            do {
+                *(void **)ptr = head;
+            } while (!owner.remote_frees.compare_exchange_weak(head, ptr, std::memory_order_release, std::memory_order_relaxed));
+        }
+    }
+
+    usize getBlockSize(const void *ptr) {
+        return ptr ? heap__size(heap__from_ptr(ptr)) : 0;
+    }
+
+    Stats getStats() {
+        heap__spin_lock(heap__lock);
+        u32 count = heap__heap_count;
+        heap__spin_unlock(heap__lock);
+
+        Stats stats;
+        for (u32 i = 1; i < count; ++i) {
+            heap__heap &h = heap__heaps[i];
+            stats.used        += h.used.load(std::memory_order_relaxed);
+            stats.peak        += h.peak.load(std::memory_order_relaxed);
+            stats.alloc_count += h.alloc_count.load(std::memory_order_relaxed);
+            stats.free_count  += h.free_count.load(std::memory_order_relaxed);
+        }
+        // committed is only touched by the owner, it's fine if it's a bit out of date
+        for (u32 i = 1; i < count; ++i) {
+            stats.committed += heap__heaps[i].committed - heap__heaps[i].start;
+        }
+        return stats;
+    }
+} // namespace heap
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "common.h"
+
+// general purpose allocator, pk_malloc and friends use it when built with PK_USE_TLSF.
+// every thread allocates from its own TLSF heap (two level segregated fit), so alloc
+// and free are O(1) and never take a lock. freeing memory that was allocated on
+// another thread hands it back to its owner, which frees it on its next allocation
+namespace heap {
+    struct Stats {
+        // bytes handed out and not freed yet, not counting the block headers
+        usize used = 0;
+        // sum of the highest usage of every thread heap
+        usize peak = 0;
+        // memory committed from the os
+        usize committed = 0;
+        u64 alloc_count = 0;
+        u64 free_count = 0;
+    };
+
+    // memory is aligned to 16 bytes
+    void *alloc(usize size);
+    void *calloc(usize size, usize count);
+    void *realloc(void *ptr, usize size);
+    void free(void *ptr);
+
+    // usable bytes in the block, can be more than what was asked for
+    usize getBlockSize(const void *ptr);
+    // totals of every heap
+    Stats getStats();
+} // namespace heap
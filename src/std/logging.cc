@@ -18,6 +18,8 @@ static const char *level_str[] = { "INFO", "WARN", "ERROR", "FATAL" };
 static void trace__set_level_colour(trace::Level level);
 static void trace__msg_box(const char *msg);
 
+static thread_local bool trace__in_scratch = false;
+
 static void trace__init_small_buf(void) {
     static byte small_buf[512];
     static Arena buf_arena;
@@ -25,6 +27,48 @@ static void trace__init_small_buf(void) {
     trace::init(buf_arena);
 }
 
+static void trace__output(trace::Level level, const char *buf) {
+    trace__set_level_colour(level);
+    printf("[%s]: ", level_str[(int)level]);
+    if (Thread::currentId() != log_thr_id) {
+        trace__set_level_colour(trace::Level::Warn);
+        printf("(0x%llx) ", Thread::currentId());
+    }
+    // reset level colour
+    trace__set_level_colour((trace::Level)-1);
+    printf("%s\n", buf);
+
+    if (level == trace::Level::Fatal) {
+        Str message = Str::fmt("Fatal Error: %s", buf);
+        CallStack::print();
+        trace__msg_box(message.cstr());
+        raise(SIGABRT);
+    }
+}
+
+static void trace__print_shared(trace::Level level, const char *fmt, va_list args, int len) {
+    log_mtx.lock();
+
+    if (!log_arena) {
+        puts("No arena provided to the logger, using instead small buffer");
+        trace__init_small_buf();
+    }
+
+    Arena scratch = *log_arena;
+
+    char *buf = scratch.alloc<char>(len + 1, Arena::SoftFail);
+    if (!buf) {
+        printf("[ERR]: trying to print string of length %d, which is more than what the arena can handle", len + 1);
+        log_mtx.unlock();
+        return;
+    }
+    vsnprintf(buf, len + 1, fmt, args);
+
+    trace__output(level, buf);
+
+    log_mtx.unlock();
+}
+
 namespace trace {
     void init(Arena &arena) {
         log_arena = &arena;
@@ -39,15 +83,6 @@ namespace trace {
     }
 
     void printv(Level level, const char *fmt, va_list args) {
-        log_mtx.lock();
-        
-        if (!log_arena) {
-            puts("No arena provided to the logger, using instead small buffer");
-            trace__init_small_buf();
-        }
-
-        Arena scratch = *log_arena;
-
         va_list va_tmp;
         va_copy(va_tmp, args);
         int len = vsnprintf(NULL, 0, fmt, va_tmp);
@@ -58,31 +93,26 @@ namespace trace {
             abort();
         }
 
-        char *buf = scratch.alloc<char>(len + 1, Arena::SoftFail);
-        if (!buf) {
-            printf("[ERR]: trying to print string of length %d, which is more than what the arena can handle", len + 1);
-            log_mtx.unlock();
+        // the scratch arena logs when it fails to allocate, in that case use the shared log arena
+        if (trace__in_scratch) {
+            trace__print_shared(level, fmt, args, len);
             return;
         }
-        len = vsnprintf(buf, len + 1, fmt, args);
 
-        trace__set_level_colour(level);
-        printf("[%s]: ", level_str[(int)level]);
-        if (Thread::currentId() != log_thr_id) {
-            trace__set_level_colour(Level::Warn);
-            printf("(0x%llx) ", Thread::currentId());
-        }
-        // reset level colour
-        trace__set_level_colour((Level)-1);
-        printf("%s\n", buf);
-
-        if (level == Level::Fatal) {
-            Str message = Str::fmt("Fatal Error: %s", buf);
-            CallStack::print();
-            trace__msg_box(message.cstr());
-            raise(SIGABRT);
+        // format on this thread's scratch arena so the lock is only held while printing
+        trace__in_scratch = true;
+        ScratchScope scratch = Arena::scratch();
+        char *buf = scratch->alloc<char>(len + 1, (Arena::Flags)(Arena::SoftFail | Arena::NoZero));
+        trace__in_scratch = false;
+
+        if (!buf) {
+            trace__print_shared(level, fmt, args, len);
+            return;
         }
+        vsnprintf(buf, len + 1, fmt, args);
 
+        log_mtx.lock();
+        trace__output(level, buf);
         log_mtx.unlock();
     }
 } // namespace trace
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <new>
 #include <string.h>
 // #include <type_traits>
 
@@ -38,10 +39,10 @@ namespace mem {
 		b = mem::move(temp);
 	}
 
+	// constructs the object in place, data doesn't need to hold a valid object already
 	template<typename T, typename ...TArgs>
 	void placementNew(void *data, TArgs &&...args) {
-		T *temp = (T *)data;
-		*temp = T(mem::move(args)...);
+		new (data) T(mem::forward<TArgs>(args)...);
 	}
 
 	constexpr usize alignTo(usize value, usize alignment) {
@@ -54,14 +55,14 @@ namespace mem {
 		ptr() = default;
 		ptr(void *p) : buf((T *)p) {}
 		ptr(T *p) : buf(p) {}
-		ptr(ptr &&p) { *this = mem::move(p); }
-		ptr &operator=(ptr &&p) { if (buf != p.buf) swap(p); return *this; }
+		ptr(ptr &&p) noexcept { *this = mem::move(p); }
+		ptr &operator=(ptr &&p) noexcept { if (buf != p.buf) swap(p); return *this; }
 		~ptr() { destroy(); }
 
 		template<typename ...TArgs>
 		static ptr make(TArgs &&...args) {
 			void *ptr = pk_malloc(sizeof(T));
-			mem::placementNew<T>(ptr, mem::move(args)...);
+			mem::placementNew<T>(ptr, mem::forward<TArgs>(args)...);
 			return (T *)ptr;
 		}
 
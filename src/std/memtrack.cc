@@ -0,0 +1,150 @@
+#include "memtrack.h"
+
+#include <atomic>
+#include <stdlib.h>
+
+// kept in front of every tracked allocation, 16 bytes so the memory stays aligned
+struct alignas(16) memtrack__header {
+    usize size;
+    MemTag tag;
+};
+
+struct memtrack__tag {
+    std::atomic<usize> live_bytes;
+    std::atomic<usize> peak_bytes;
+    std::atomic<u64> alloc_count;
+    std::atomic<u64> free_count;
+};
+
+static memtrack__tag memtrack__tags[(int)MemTag::Count];
+static thread_local MemTag memtrack__current_tag = MemTag::Std;
+static std::atomic<usize> memtrack__arena_reserved;
+static std::atomic<usize> memtrack__arena_committed;
+
+static const char *memtrack__tag_names[] = {
+    "std",
+    "formats",
+    "assets",
+    "gfx",
+    "jobs",
+};
+static_assert(pk_arrlen(memtrack__tag_names) == (usize)MemTag::Count);
+
+static void memtrack__on_alloc(MemTag tag, usize size) {
+    memtrack__tag &stats = memtrack__tags[(int)tag];
+    usize live = stats.live_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+    usize peak = stats.peak_bytes.load(std::memory_order_relaxed);
+    while (live > peak && !stats.peak_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+    }
+    stats.alloc_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+static void memtrack__on_free(MemTag tag, usize size) {
+    memtrack__tag &stats = memtrack__tags[(int)tag];
+    stats.live_bytes.fetch_sub(size, std::memory_order_relaxed);
+    stats.free_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+static void *memtrack__finish_alloc(void *raw, usize size, MemTag tag) {
+    if (!raw) {
+        return nullptr;
+    }
+    memtrack__header *header = (memtrack__header *)raw;
+    header->size = size;
+    header->tag = tag;
+    memtrack__on_alloc(tag, size);
+    return header + 1;
+}
+
+namespace memtrack {
+    MemTag getTag() {
+        return memtrack__current_tag;
+    }
+
+    MemTag setTag(MemTag tag) {
+        MemTag prev = memtrack__current_tag;
+        memtrack__current_tag = tag;
+        return prev;
+    }
+
+    void *alloc(usize size) {
+        return memtrack__finish_alloc(pk__sys_malloc(sizeof(memtrack__header) + size), size, memtrack__current_tag);
+    }
+
+    void *calloc(usize size, usize count) {
+        usize total = size * count;
+        return memtrack__finish_alloc(pk__sys_calloc(sizeof(memtrack__header) + total, 1), total, memtrack__current_tag);
+    }
+
+    void *realloc(void *ptr, usize size) {
+        if (!ptr) {
+            return alloc(size);
+        }
+
+        memtrack__header *header = (memtrack__header *)ptr - 1;
+        MemTag old_tag = header->tag;
+        usize old_size = header->size;
+
+        void *raw = pk__sys_realloc(header, sizeof(memtrack__header) + size);
+        if (!raw) {
+            return nullptr;
+        }
+        // the memory stays with whoever allocated it first
+        memtrack__on_free(old_tag, old_size);
+        return memtrack__finish_alloc(raw, size, old_tag);
+    }
+
+    void free(void *ptr) {
+        if (!ptr) {
+            return;
+        }
+        memtrack__header *header = (memtrack__header *)ptr - 1;
+        memtrack__on_free(header->tag, header->size);
+        pk__sys_free(header);
+    }
+
+    bool isEnabled() {
+        return PK_TRACK_ALLOCS;
+    }
+
+    const char *getTagName(MemTag tag) {
+        return (usize)tag < (usize)MemTag::Count ? memtrack__tag_names[(int)tag] : "unknown";
+    }
+
+    TagStats getTagStats(MemTag tag) {
+        TagStats out;
+        if ((usize)tag >= (usize)MemTag::Count) {
+            return out;
+        }
+        memtrack__tag &stats = memtrack__tags[(int)tag];
+        out.live_bytes  = stats.live_bytes.load(std::memory_order_relaxed);
+        out.peak_bytes  = stats.peak_bytes.load(std::memory_order_relaxed);
+        out.alloc_count = stats.alloc_count.load(std::memory_order_relaxed);
+        out.free_count  = stats.free_count.load(std::memory_order_relaxed);
+        return out;
+    }
+
+    TagStats getTotalStats() {
+        TagStats out;
+        for (int i = 0; i < (int)MemTag::Count; ++i) {
+            TagStats stats = getTagStats((MemTag)i);
+            out.live_bytes  += stats.live_bytes;
+            out.peak_bytes  += stats.peak_bytes;
+            out.alloc_count += stats.alloc_count;
+            out.free_count  += stats.free_count;
+        }
+        return out;
+    }
+
+    ArenaStats getArenaStats() {
+        return {
+            .reserved  = memtrack__arena_reserved.load(std::memory_order_relaxed),
+            .committed = memtrack__arena_committed.load(std::memory_order_relaxed),
+        };
+    }
+
+    void trackArena(isize reserved_delta, isize committed_delta) {
+        memtrack__arena_reserved.fetch_add((usize)reserved_delta, std::memory_order_relaxed);
+        memtrack__arena_committed.fetch_add((usize)committed_delta, std::memory_order_relaxed);
+    }
+} // namespace memtrack
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "common.h"
+
+// opt-in allocation tracking, enabled by building with PK_TRACK_ALLOCS.
+// every pk_malloc is tagged with the current tag of the calling thread, which the entry
+// points of each subsystem set with a TagScope. jobs keep the tag of whoever pushed them.
+// virtual arenas report how much memory they reserve and commit
+namespace memtrack {
+    struct TagStats {
+        usize live_bytes = 0;
+        usize peak_bytes = 0;
+        u64 alloc_count = 0;
+        u64 free_count = 0;
+    };
+
+    struct ArenaStats {
+        usize reserved = 0;
+        usize committed = 0;
+    };
+
+    // tag of the calling thread, Std unless a TagScope says otherwise
+    MemTag getTag();
+    // returns the previous tag
+    MemTag setTag(MemTag tag);
+
+    // sets the tag until the end of the scope
+    struct TagScope {
+        TagScope(MemTag tag) : prev(setTag(tag)) {}
+        ~TagScope() { setTag(prev); }
+        TagScope(const TagScope &) = delete;
+
+        MemTag prev;
+    };
+
+    bool isEnabled();
+    const char *getTagName(MemTag tag);
+    TagStats getTagStats(MemTag tag);
+    // peak_bytes is the sum of the peaks of every tag
+    TagStats getTotalStats();
+    ArenaStats getArenaStats();
+
+    // called by the virtual arenas when they reserve, commit or give back memory
+    void trackArena(isize reserved_delta, isize committed_delta);
+} // namespace memtrack
@@ -0,0 +1,38 @@
+#include "pool.h"
+
+template<usize size>
+struct pool__block {
+    alignas(16) byte data[size];
+};
+
+template<usize size>
+static Pool<pool__block<size>, true> &pool__get_blocks() {
+    // function statics so functors can be allocated during static initialisation
+    static Pool<pool__block<size>, true> blocks;
+    return blocks;
+}
+
+namespace mem {
+    void *allocBlock(usize size) {
+        if (size <= 64)  return pool__get_blocks<64>().alloc();
+        if (size <= 128) return pool__get_blocks<128>().alloc();
+        if (size <= 256) return pool__get_blocks<256>().alloc();
+        return nullptr;
+    }
+
+    bool freeBlock(void *ptr) {
+        if (pool__get_blocks<64>().owns(ptr)) {
+            pool__get_blocks<64>().free((pool__block<64> *)ptr);
+            return true;
+        }
+        if (pool__get_blocks<128>().owns(ptr)) {
+            pool__get_blocks<128>().free((pool__block<128> *)ptr);
+            return true;
+        }
+        if (pool__get_blocks<256>().owns(ptr)) {
+            pool__get_blocks<256>().free((pool__block<256> *)ptr);
+            return true;
+        }
+        return false;
+    }
+} // namespace mem
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <atomic>
+#include <new>
+
+#include "common.h"
+#include "arena.h"
+#include "mem.h"
+#include "threads.h"
+
+// fixed size object pool with O(1) alloc and free. objects are stored in a virtual arena
+// so they never move and an index can be used as a handle. pages are only committed when
+// the pool grows and freed objects are reused before growing again.
+// the thread safe version uses a lock-free freelist, the lock is only taken to grow
+template<typename T, bool is_thread_safe = false>
+struct Pool {
+    Pool(usize max_count = 1 << 20) : max_count(max_count) {}
+    ~Pool() { cleanup(); }
+
+    // destroys the objects that are still allocated and gives the memory back,
+    // no other thread can be using the pool
+    void cleanup();
+
+    template<typename ...TArgs>
+    T *alloc(TArgs &&...args);
+    void free(T *ptr);
+
+    // same as alloc and free, but the object is referred to by its index
+    template<typename ...TArgs>
+    u32 allocIndex(TArgs &&...args);
+    void freeIndex(u32 index);
+
+    T *fromIndex(u32 index) const { return (T *)(arena.start + index * kslot_size); }
+    u32 indexOf(const T *ptr) const { return (u32)(((const byte *)ptr - arena.start) / kslot_size); }
+    bool owns(const void *ptr) const { return ptr >= arena.start && ptr < arena.start + count * kslot_size; }
+    // number of slots ever allocated, every valid index is smaller than this
+    u32 size() const { return count.load(std::memory_order_acquire); }
+
+private:
+    // a free slot stores the index of the next free slot at its start
+    static constexpr usize kslot_align = alignof(T) > alignof(u32) ? alignof(T) : alignof(u32);
+    static constexpr usize kslot_size = mem::alignTo(sizeof(T) > sizeof(u32) ? sizeof(T) : sizeof(u32), kslot_align);
+    static constexpr u32 knull = UINT32_MAX;
+    static constexpr byte kpoison = 0xDD;
+
+    std::atomic<u32> &link(u32 index) const { return *(std::atomic<u32> *)fromIndex(index); }
+
+    u32 popFree();
+    void pushFree(u32 index);
+    u32 grow();
+
+    // top 32 bits are a tag that changes on every push to avoid ABA, bottom 32 are the index
+    std::atomic<u64> free_head = knull;
+    std::atomic<u32> count = 0;
+    usize max_count;
+    Arena arena;
+    Mutex grow_mtx;
+};
+
+// fixed size blocks for small heap allocations that can't have their own pool,
+// like type erased functors
+namespace mem {
+    // returns null if size is bigger than the biggest block
+    void *allocBlock(usize size);
+    // returns false if ptr wasn't allocated with allocBlock
+    bool freeBlock(void *ptr);
+} // namespace mem
+
+template<typename T, bool is_thread_safe>
+void Pool<T, is_thread_safe>::cleanup() {
+    if (!arena.start) {
+        return;
+    }
+
+    if constexpr (!std::is_trivially_destructible_v<T>) {
+        u32 slot_count = size();
+        ScratchScope scratch = Arena::scratch();
+        bool *is_free = scratch->alloc<bool>(slot_count);
+        for (u32 i = (u32)free_head.load(); i != knull; i = link(i).load(std::memory_order_relaxed)) {
+            is_free[i] = true;
+        }
+        for (u32 i = 0; i < slot_count; ++i) {
+            if (!is_free[i]) {
+                fromIndex(i)->~T();
+            }
+        }
+    }
+
+    // moving it out leaves the arena empty, and the memory is released at the end of the scope
+    Arena old = mem::move(arena);
+    free_head = knull;
+    count = 0;
+}
+
+template<typename T, bool is_thread_safe>
+template<typename ...TArgs>
+T *Pool<T, is_thread_safe>::alloc(TArgs &&...args) {
+    u32 index = allocIndex(mem::forward<TArgs>(args)...);
+    return index == knull ? nullptr : fromIndex(index);
+}
+
+template<typename T, bool is_thread_safe>
+void Pool<T, is_thread_safe>::free(T *ptr) {
+    if (ptr) {
+        freeIndex(indexOf(ptr));
+    }
+}
+
+template<typename T, bool is_thread_safe>
+template<typename ...TArgs>
+u32 Pool<T, is_thread_safe>::allocIndex(TArgs &&...args) {
+    u32 index = popFree();
+    if (index == knull) {
+        index = grow();
+        if (index == knull) {
+            return knull;
+        }
+    }
+    new (fromIndex(index)) T(mem::forward<TArgs>(args)...);
+    return index;
+}
+
+template<typename T, bool is_thread_safe>
+void Pool<T, is_thread_safe>::freeIndex(u32 index) {
+    pk_assert(index < size());
+    fromIndex(index)->~T();
+#if PK_DEBUG
+    // catches anyone still using the object, the link is written by pushFree
+    memset(fromIndex(index), kpoison, kslot_size);
+#endif
+    pushFree(index);
+}
+
+template<typename T, bool is_thread_safe>
+u32 Pool<T, is_thread_safe>::popFree() {
+    u64 head = free_head.load(std::memory_order_acquire);
+    while ((u32)head != knull) {
+        u32 index = (u32)head;
+        // the slot might be popped and pushed again by someone else while we read it,
+        // the memory stays committed until cleanup, and the tag makes the exchange fail
+        u32 next = link(index).load(std::memory_order_relaxed);
+        u64 new_head = (head & 0xFFFFFFFF00000000ull) | next;
+        if constexpr (is_thread_safe) {
+            if (free_head.compare_exchange_weak(head, new_head, std::memory_order_acquire, std::memory_order_acquire)) {
+                return index;
+            }
+        }
+        else {
+            free_head.store(new_head, std::memory_order_relaxed);
+            return index;
+        }
+    }
+    return knull;
+}
+
+template<typename T, bool is_thread_safe>
+void Pool<T, is_thread_safe>::pushFree(u32 index) {
+    u64 head = free_head.load(std::memory_order_relaxed);
+    u64 new_head;
+    do {
+        link(index).store((u32)head, std::memory_order_relaxed);
+        u64 tag = (head >> 32) + 1;
+        new_head = (tag << 32) | index;
+        if constexpr (!is_thread_safe) {
+            free_head.store(new_head, std::memory_order_relaxed);
+            return;
+        }
+    } while (!free_head.compare_exchange_weak(head, new_head, std::memory_order_release, std::memory_order_relaxed));
+}
+
+template<typename T, bool is_thread_safe>
+u32 Pool<T, is_thread_safe>::grow() {
+    if constexpr (is_thread_safe) {
+        grow_mtx.lock();
+    }
+
+    u32 index = knull;
+    if (!arena.start) {
+        arena = Arena::make(max_count * kslot_size, Arena::Virtual);
+    }
+    // the arena only commits new pages when it needs to
+    if (arena.start && arena.alloc(kslot_size, 1, kslot_align, (Arena::Flags)(Arena::SoftFail | Arena::NoZero))) {
+        index = count.load(std::memory_order_relaxed);
+        count.store(index + 1, std::memory_order_release);
+    }
+
+    if constexpr (is_thread_safe) {
+        grow_mtx.unlock();
+    }
+    return index;
+}
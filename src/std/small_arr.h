@@ -0,0 +1,217 @@
+#pragma once
+
+#include <new>
+#include <initializer_list>
+#include <string.h>
+#include <type_traits>
+
+#include "common.h"
+#include "mem.h"
+#include "maths.h"
+#include "slice.h"
+
+// arr with room for N elements inside the struct, it only allocates once it grows
+// past that. useful for small lists that are built and thrown away often
+template<typename T, usize N>
+struct SmallArr {
+	static_assert(N > 0, "use arr if there's no inline storage");
+
+	using iterator = T *;
+	using const_iterator = const T *;
+
+	SmallArr() = default;
+	SmallArr(const SmallArr &a) { *this = a; }
+	SmallArr(SmallArr &&a) noexcept(std::is_nothrow_move_constructible_v<T>) { *this = mem::move(a); }
+	SmallArr(std::initializer_list<T> list) {
+		reserve(list.size());
+		for (auto &&v : list) push(v);
+	}
+	~SmallArr() { destroy(); }
+
+	void destroy() {
+		clear();
+		if (!isInline()) {
+			pk_free(buf);
+		}
+		buf = inlineBuf();
+		cap = N;
+	}
+
+	void reserve(usize new_cap) {
+		if (cap < new_cap) {
+			reallocate(math::max(cap * 2, new_cap));
+		}
+	}
+
+	// resize without constructing the objects, the new elements are uninitialised
+	void grow(usize new_len) {
+		reserve(new_len);
+		len = new_len;
+	}
+
+	void resize(usize new_len) {
+		if constexpr (std::is_trivial_v<T>) {
+			reserve(new_len);
+			if (new_len > len) {
+				memset(buf + len, 0, sizeof(T) * (new_len - len));
+			}
+			len = new_len;
+			return;
+		}
+
+		while (new_len < len) {
+			pop();
+		}
+
+		reserve(new_len);
+		while (new_len > len) {
+			push();
+		}
+	}
+
+	template<typename ...TArgs>
+	T &push(TArgs &&...args) {
+		reserve(len + 1);
+		mem::placementNew<T>(buf + len, mem::forward<TArgs>(args)...);
+		return buf[len++];
+	}
+
+	T &push(const T &value) {
+		reserve(len + 1);
+		mem::placementNew<T>(buf + len, value);
+		return buf[len++];
+	}
+
+	void clear() {
+		if constexpr (!std::is_trivially_destructible_v<T>) {
+			for (usize i = 0; i < len; ++i) {
+				buf[i].~T();
+			}
+		}
+		len = 0;
+	}
+
+	void pop() {
+		if (len) {
+			buf[--len].~T();
+		}
+	}
+
+	void remove(usize index) {
+		if (index >= len) return;
+		mem::swap(buf[index], buf[len - 1]);
+		pop();
+	}
+
+	usize find(const T &value) const {
+		for (usize i = 0; i < len; ++i) {
+			if (buf[i] == value) {
+				return i;
+			}
+		}
+		return SIZE_MAX;
+	}
+
+	bool contains(const T &value) const {
+		return find(value) != SIZE_MAX;
+	}
+
+	SmallArr &operator=(const SmallArr &a) {
+		if (this != &a) {
+			clear();
+			reserve(a.len);
+			for (usize i = 0; i < a.len; ++i) {
+				push(a[i]);
+			}
+		}
+		return *this;
+	}
+
+	SmallArr &operator=(SmallArr &&a) noexcept(std::is_nothrow_move_constructible_v<T>) {
+		if (this == &a) return *this;
+
+		destroy();
+		if (!a.isInline()) {
+			// steal the heap buffer
+			buf = a.buf;
+			len = a.len;
+			cap = a.cap;
+			a.buf = a.inlineBuf();
+			a.len = 0;
+			a.cap = N;
+			return *this;
+		}
+
+		// the elements live inside of a, they have to be moved one by one
+		for (usize i = 0; i < a.len; ++i) {
+			mem::placementNew<T>(buf + i, mem::move(a.buf[i]));
+		}
+		len = a.len;
+		a.clear();
+		return *this;
+	}
+
+	bool isInline() const { return buf == inlineBuf(); }
+
+	bool empty() const { return len == 0; }
+	usize size() const { return len; }
+	usize capacity() const { return cap; }
+	usize byteSize() const { return len * sizeof(T); }
+
+	operator Slice<T>() const { return Slice<T>(buf, len); }
+
+	T *data() { return buf; }
+	T &operator[](usize index) { pk_assert(index < len); return buf[index]; }
+	T *begin() { return buf; }
+	T *end() { return buf + len; }
+	T &front() { pk_assert(len); return buf[0]; }
+	T &back() { pk_assert(len); return buf[len - 1]; }
+
+	const T *data() const { return buf; }
+	const T &operator[](usize index) const { pk_assert(index < len); return buf[index]; }
+	const T *begin() const { return buf; }
+	const T *end() const { return buf + len; }
+	const T &front() const { pk_assert(len); return buf[0]; }
+	const T &back() const { pk_assert(len); return buf[len - 1]; }
+
+private:
+	T *inlineBuf() { return (T *)storage; }
+	const T *inlineBuf() const { return (const T *)storage; }
+
+	void reallocate(usize newcap) {
+		T *newbuf = nullptr;
+		if constexpr (std::is_trivially_copyable_v<T>) {
+			if (!isInline()) {
+				newbuf = (T *)pk_realloc(buf, sizeof(T) * newcap);
+				pk_assert(newbuf);
+				buf = newbuf;
+				cap = newcap;
+				return;
+			}
+			newbuf = (T *)pk_malloc(sizeof(T) * newcap);
+			pk_assert(newbuf);
+			if (len) {
+				memcpy(newbuf, buf, sizeof(T) * len);
+			}
+		}
+		else {
+			newbuf = (T *)pk_malloc(sizeof(T) * newcap);
+			pk_assert(newbuf);
+			for (usize i = 0; i < len; ++i) {
+				mem::placementNew<T>(newbuf + i, mem::move(buf[i]));
+				buf[i].~T();
+			}
+		}
+
+		if (!isInline()) {
+			pk_free(buf);
+		}
+		buf = newbuf;
+		cap = newcap;
+	}
+
+	alignas(T) byte storage[sizeof(T) * N];
+	T *buf = inlineBuf();
+	usize len = 0;
+	usize cap = N;
+};
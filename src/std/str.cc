@@ -9,6 +9,7 @@
 #include "mem.h"
 #include "stream.h"
 #include "hash.h"
+#include "maths.h"
 
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
@@ -178,13 +179,219 @@ namespace StrUtils {
     }
 } // namespace StrUtils
 
-// use left-most bit as bitflag for owning
-static constexpr u64 str_not_owned_flags = 1ull << 63;
-static constexpr u64 str_size_mask = ~str_not_owned_flags;
-static constexpr bool str__is_owned(usize len) {
-    return !(len & str_not_owned_flags);
+// == SEARCH ===========================================================================================================
+
+#if defined(__AVX2__)
+#define PK_STR_SIMD 1
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PK_STR_SIMD 1
+#include <emmintrin.h>
+#else
+#define PK_STR_SIMD 0
+#endif
+
+#if PK_WINDOWS
+#include <intrin.h>
+#endif
+
+static u32 str__ffs(u32 value) {
+#if PK_WINDOWS
+    unsigned long index;
+    _BitScanForward(&index, value);
+    return (u32)index;
+#else
+    return (u32)__builtin_ctz(value);
+#endif
+}
+
+static u32 str__fls(u32 value) {
+#if PK_WINDOWS
+    unsigned long index;
+    _BitScanReverse(&index, value);
+    return (u32)index;
+#else
+    return 31 - (u32)__builtin_clz(value);
+#endif
+}
+
+static bool str__is_space(char c) {
+    // '\t', '\n', '\v', '\f' and '\r' are 9 to 13
+    return c == ' ' || (u8)(c - '\t') <= 4;
+}
+
+// the search functions are written once on top of these, one bit per char in the masks
+#if defined(__AVX2__)
+using str__vec = __m256i;
+static constexpr usize str__width = 32;
+static constexpr u32 str__full_mask = 0xFFFFFFFF;
+
+static str__vec str__load(const char *p)            { return _mm256_loadu_si256((const __m256i *)p); }
+static str__vec str__splat(char c)                  { return _mm256_set1_epi8(c); }
+static str__vec str__eq(str__vec a, str__vec b)     { return _mm256_cmpeq_epi8(a, b); }
+static str__vec str__or(str__vec a, str__vec b)     { return _mm256_or_si256(a, b); }
+static str__vec str__and(str__vec a, str__vec b)    { return _mm256_and_si256(a, b); }
+static str__vec str__sub(str__vec a, str__vec b)    { return _mm256_sub_epi8(a, b); }
+static str__vec str__min_u8(str__vec a, str__vec b) { return _mm256_min_epu8(a, b); }
+static u32 str__mask(str__vec v)                    { return (u32)_mm256_movemask_epi8(v); }
+#elif PK_STR_SIMD
+using str__vec = __m128i;
+static constexpr usize str__width = 16;
+static constexpr u32 str__full_mask = 0xFFFF;
+
+static str__vec str__load(const char *p)            { return _mm_loadu_si128((const __m128i *)p); }
+static str__vec str__splat(char c)                  { return _mm_set1_epi8(c); }
+static str__vec str__eq(str__vec a, str__vec b)     { return _mm_cmpeq_epi8(a, b); }
+static str__vec str__or(str__vec a, str__vec b)     { return _mm_or_si128(a, b); }
+static str__vec str__and(str__vec a, str__vec b)    { return _mm_and_si128(a, b); }
+static str__vec str__sub(str__vec a, str__vec b)    { return _mm_sub_epi8(a, b); }
+static str__vec str__min_u8(str__vec a, str__vec b) { return _mm_min_epu8(a, b); }
+static u32 str__mask(str__vec v)                    { return (u32)_mm_movemask_epi8(v); }
+#endif
+
+// sets bigger than this use a lookup table instead of one compare per char
+static constexpr usize str__max_simd_set = 8;
+
+namespace StrUtils {
+
+usize findChar(const char *buf, usize len, char c) {
+    usize i = 0;
+#if PK_STR_SIMD
+    const str__vec needle = str__splat(c);
+    for (; (i + str__width) <= len; i += str__width) {
+        if (u32 mask = str__mask(str__eq(str__load(buf + i), needle))) {
+            return i + str__ffs(mask);
+        }
+    }
+#endif
+    for (; i < len; ++i) {
+        if (buf[i] == c) return i;
+    }
+    return len;
+}
+
+usize rfindChar(const char *buf, usize len, char c) {
+    usize i = len;
+#if PK_STR_SIMD
+    const str__vec needle = str__splat(c);
+    while (i >= str__width) {
+        i -= str__width;
+        if (u32 mask = str__mask(str__eq(str__load(buf + i), needle))) {
+            return i + str__fls(mask);
+        }
+    }
+#endif
+    while (i > 0) {
+        --i;
+        if (buf[i] == c) return i;
+    }
+    return len;
 }
 
+usize findAnyOf(const char *buf, usize len, const char *set, usize set_len) {
+    if (set_len == 0) return len;
+    if (set_len == 1) return findChar(buf, len, set[0]);
+
+    usize i = 0;
+#if PK_STR_SIMD
+    if (set_len <= str__max_simd_set) {
+        str__vec needles[str__max_simd_set];
+        for (usize k = 0; k < set_len; ++k) {
+            needles[k] = str__splat(set[k]);
+        }
+
+        for (; (i + str__width) <= len; i += str__width) {
+            const str__vec chunk = str__load(buf + i);
+            str__vec found = str__eq(chunk, needles[0]);
+            for (usize k = 1; k < set_len; ++k) {
+                found = str__or(found, str__eq(chunk, needles[k]));
+            }
+            if (u32 mask = str__mask(found)) {
+                return i + str__ffs(mask);
+            }
+        }
+    }
+#endif
+
+    u64 table[4] = {};
+    for (usize k = 0; k < set_len; ++k) {
+        const u8 c = (u8)set[k];
+        table[c >> 6] |= 1ull << (c & 63);
+    }
+
+    for (; i < len; ++i) {
+        const u8 c = (u8)buf[i];
+        if (table[c >> 6] & (1ull << (c & 63))) return i;
+    }
+    return len;
+}
+
+usize findSub(const char *buf, usize len, const char *sub, usize sub_len) {
+    if (sub_len == 0) return 0;
+    if (sub_len > len) return len;
+    if (sub_len == 1) return findChar(buf, len, sub[0]);
+
+    // last position a match can start at
+    const usize last = len - sub_len;
+    usize i = 0;
+
+#if PK_STR_SIMD
+    // only the positions where both the first and last char match get compared
+    const str__vec first = str__splat(sub[0]);
+    const str__vec last_char = str__splat(sub[sub_len - 1]);
+    for (; (i + str__width) <= (last + 1); i += str__width) {
+        const str__vec match_first = str__eq(str__load(buf + i), first);
+        const str__vec match_final = str__eq(str__load(buf + i + sub_len - 1), last_char);
+        for (u32 mask = str__mask(str__and(match_first, match_final)); mask; mask &= mask - 1) {
+            const usize pos = i + str__ffs(mask);
+            if (memcmp(buf + pos + 1, sub + 1, sub_len - 2) == 0) {
+                return pos;
+            }
+        }
+    }
+#endif
+
+    for (; i <= last; ++i) {
+        if (buf[i] == sub[0] && memcmp(buf + i + 1, sub + 1, sub_len - 1) == 0) {
+            return i;
+        }
+    }
+    return len;
+}
+
+usize skipWhitespace(const char *buf, usize len) {
+    usize i = 0;
+#if PK_STR_SIMD
+    const str__vec space = str__splat(' ');
+    const str__vec tab   = str__splat('\t');
+    const str__vec range = str__splat(4);
+    for (; (i + str__width) <= len; i += str__width) {
+        const str__vec chunk = str__load(buf + i);
+        // unsigned c - '\t' <= 4 is the same as min(c - '\t', 4) == c - '\t'
+        const str__vec offset = str__sub(chunk, tab);
+        const str__vec is_ctrl = str__eq(str__min_u8(offset, range), offset);
+        const str__vec is_space = str__or(str__eq(chunk, space), is_ctrl);
+        if (u32 mask = ~str__mask(is_space) & str__full_mask) {
+            return i + str__ffs(mask);
+        }
+    }
+#endif
+    for (; i < len; ++i) {
+        if (!str__is_space(buf[i])) return i;
+    }
+    return len;
+}
+
+} // namespace StrUtils
+
+// == STR ==============================================================================================================
+
+// a pointer, a length and a capacity, which leaves room for 22 chars, the terminator and the tag inline
+static_assert(sizeof(Str) == 24, "Str is deliberately 24 bytes");
+
+static constexpr usize str__cap_bits = 56;
+static constexpr usize str__cap_mask = (1ull << str__cap_bits) - 1;
+
 Str::Str(const char *cstr) {
     if (cstr) {
         init(cstr, strlen(cstr));
@@ -207,7 +414,7 @@ Str::Str(StrView view) {
     }
 }
 
-Str::Str(Str &&str) {
+Str::Str(Str &&str) noexcept {
     *this = mem::move(str);
 }
 
@@ -242,9 +449,9 @@ Str Str::fmt(const char *fmt, ...) {
 }
 
 Str Str::fmtv(const char *fmt, va_list args) {
-    OutStream ostr;
-    ostr.printv(fmt, args);
-    return ostr.asStr();
+    StrBuilder builder;
+    builder.printv(fmt, args);
+    return builder.finish();
 }
 
 Str Str::fmt(Arena &arena, const char *fmt, ...) {
@@ -266,76 +473,156 @@ Str Str::cat(Slice<StrView> strings) {
     for (StrView s : strings) {
         total_size += s.len;
     }
-    
-    char *buf = (char *)pk_malloc(total_size + 1);
-    pk_assert(buf);
 
-    char *cur = buf;
+    StrBuilder builder(total_size);
     for (StrView s : strings) {
-        memcpy(cur, s.buf, s.len);
-        cur += s.len;
+        builder.push(s);
     }
+    return builder.finish();
+}
 
-    Str out;
-    out.moveFrom(buf, total_size);
-    return out;
+void Str::setSmall(const char *cstr, usize cstr_len) {
+    pk_assert(cstr_len <= kmax_small);
+    // memmove, cstr might point inside of small
+    memmove(small, cstr, cstr_len);
+    memset(small + cstr_len, 0, sizeof(small) - cstr_len);
+    small[sizeof(Large) - 1] = (char)(cstr_len | Small);
+}
+
+void Str::setLarge(char *buf, usize buf_len, usize buf_cap, Kind kind) {
+    pk_assert(buf_cap <= str__cap_mask);
+    large.buf = buf;
+    large.len = buf_len;
+    large.cap_tag = buf_cap | ((usize)kind << str__cap_bits);
+}
+
+usize Str::capacity() const {
+    switch (kind()) {
+        case Small: return kmax_small;
+        case Heap:  return large.cap_tag & str__cap_mask;
+        default:    return large.len;
+    }
 }
 
 void Str::init(const char *cstr, usize cstr_len) {
-    buf = (char *)pk_malloc(cstr_len + 1);
-    pk_assert(buf);
-    memcpy(buf, cstr, cstr_len);
-    buf[cstr_len] = '\0';
-    len = cstr_len;
+    if (cstr_len <= kmax_small) {
+        // copy first, cstr could be pointing to our own buffer
+        char temp[kmax_small];
+        memcpy(temp, cstr, cstr_len);
+        destroy();
+        setSmall(temp, cstr_len);
+        return;
+    }
+
+    char *newbuf = (char *)pk_malloc(cstr_len + 1);
+    pk_assert(newbuf);
+    memcpy(newbuf, cstr, cstr_len);
+    newbuf[cstr_len] = '\0';
+    destroy();
+    setLarge(newbuf, cstr_len, cstr_len, Heap);
 }
 
 void Str::init(Arena &arena, const char *cstr, usize cstr_len) {
-    buf = arena.alloc<char>(cstr_len);
-    memcpy(buf, cstr, cstr_len);
-    len = cstr_len | str_not_owned_flags;
+    char *newbuf = arena.alloc<char>(cstr_len + 1, Arena::NoZero);
+    memcpy(newbuf, cstr, cstr_len);
+    newbuf[cstr_len] = '\0';
+    destroy();
+    setLarge(newbuf, cstr_len, cstr_len, Borrowed);
 }
 
 void Str::moveFrom(char *str, usize str_len) {
-    buf = str;
-    len = str_len;
+    destroy();
+    setLarge(str, str_len, str_len, Heap);
+}
+
+void Str::borrowFrom(char *str, usize str_len) {
+    destroy();
+    setLarge(str, str_len, str_len, Borrowed);
 }
 
 Str Str::dup(Arena &arena) const {
     Str out;
-    out.init(arena, buf, size());
+    out.init(arena, data(), size());
     return out;
 }
 
 void Str::destroy() {
-    if (str__is_owned(len)) {
-        pk_free(buf);
+    if (kind() == Heap) {
+        pk_free(large.buf);
     }
-    buf = nullptr;
-    len = 0;
+    memset(small, 0, sizeof(small));
 }
 
 void Str::resize(usize new_len) {
-    usize sz = size();
-    if (new_len == sz) return;
-    char *newbuf = (char *)pk_realloc(buf, new_len + 1);
+    const usize old_len = size();
+    if (new_len == old_len) return;
+
+    const Kind k = kind();
+
+    // fits in what we already have
+    if ((k == Small && new_len <= kmax_small) || (k != Small && new_len <= capacity())) {
+        char *buf = data();
+        if (new_len > old_len) {
+            memset(buf + old_len, 0, new_len - old_len);
+        }
+        buf[new_len] = '\0';
+        if (k == Small) {
+            small[sizeof(Large) - 1] = (char)(new_len | Small);
+        }
+        else {
+            large.len = new_len;
+        }
+        return;
+    }
+
+    // grow geometrically so that growing a string a bit at a time is amortised
+    const usize new_cap = math::max(new_len, capacity() * 2);
+
+    if (k == Heap) {
+        char *newbuf = (char *)pk_realloc(large.buf, new_cap + 1);
+        pk_assert(newbuf);
+        memset(newbuf + old_len, 0, new_len - old_len + 1);
+        setLarge(newbuf, new_len, new_cap, Heap);
+        return;
+    }
+
+    // either inline or borrowed memory, move it to the heap
+    char *newbuf = (char *)pk_calloc(1, new_cap + 1);
     pk_assert(newbuf);
-    buf = newbuf;
-    bool owned = isOwned();
-    // set the rest of the string to zero from the previos null terminator
-    memset(buf + len + 1, 0, new_len - len);
-    len = new_len;
-    if (owned) len |= str_not_owned_flags;
+    memcpy(newbuf, data(), old_len);
+    destroy();
+    setLarge(newbuf, new_len, new_cap, Heap);
 }
 
 void Str::resize(Arena &arena, usize new_len) {
-    usize sz = size();
-    if (new_len == sz) return;
+    const usize old_len = size();
+    if (new_len == old_len) return;
+
+    // zeroed, which also terminates it
     char *newbuf = arena.alloc<char>(new_len + 1);
     pk_assert(newbuf);
-    memcpy(newbuf, buf, sz);
-    bool owned = isOwned();
-    len = new_len;
-    if (owned) len |= str_not_owned_flags;
+    memcpy(newbuf, data(), math::min(old_len, new_len));
+    destroy();
+    setLarge(newbuf, new_len, new_len, Borrowed);
+}
+
+void Str::reserve(usize new_cap) {
+    if (new_cap <= capacity() && kind() != Borrowed) return;
+    if (new_cap <= kmax_small) return;
+
+    const usize len = size();
+    char *newbuf = nullptr;
+    if (kind() == Heap) {
+        newbuf = (char *)pk_realloc(large.buf, new_cap + 1);
+        pk_assert(newbuf);
+    }
+    else {
+        newbuf = (char *)pk_malloc(new_cap + 1);
+        pk_assert(newbuf);
+        memcpy(newbuf, data(), len + 1);
+        destroy();
+    }
+    setLarge(newbuf, len, new_cap, Heap);
 }
 
 void Str::replace(char from, char to) {
@@ -346,15 +633,11 @@ void Str::replace(char from, char to) {
     }
 }
 
-bool Str::empty() const {
-    return size() == 0;
-}
-
 StrView Str::sub(usize from, usize to) {
     usize max = size();
     if (to > max) to = max;
     if (from > to) from = to;
-    return StrView(buf + from, to - from);
+    return StrView(data() + from, to - from);
 }
 
 void Str::lower() {
@@ -393,96 +676,155 @@ Str Str::toUpper(Arena &arena) const {
     return out;
 }
 
-char *Str::data() {
-    return buf;
-}
-
-const char *Str::data() const {
-    return buf;
-}
-
-const char *Str::cstr() const {
-    return buf;
-}
-
-usize Str::size() const {
-    return len & str_size_mask;
-}
-
-bool Str::isOwned() const {
-    return str__is_owned(len);
-}
-
 char *Str::begin() {
-    return buf;
+    return data();
 }
 
 char *Str::end() {
-    return buf + size();
+    return data() + size();
 }
 
 char &Str::back() {
     pk_assert(!empty());
-    return buf[size() - 1];
+    return data()[size() - 1];
 }
 
 char &Str::front() {
     pk_assert(!empty());
-    return buf[0];
+    return data()[0];
 }
 
 char &Str::operator[](usize index) {
     pk_assert(index < size());
-    return buf[index];
+    return data()[index];
 }
 
 const char *Str::begin() const {
-    return buf;
+    return data();
 }
 
 const char *Str::end() const {
-    return buf + size();
+    return data() + size();
 }
 
 const char &Str::back() const {
     pk_assert(!empty());
-    return buf[size() - 1];
+    return data()[size() - 1];
 }
 
 const char &Str::front() const {
     pk_assert(!empty());
-    return buf[0];
+    return data()[0];
 }
 
 const char &Str::operator[](usize index) const {
     pk_assert(index < size());
-    return buf[index];
+    return data()[index];
 }
 
-Str &Str::operator=(Str &&str) {
+Str &Str::operator=(Str &&str) noexcept {
     if (this != &str) {
-        mem::swap(buf, str.buf);
-        mem::swap(len, str.len);
+        // inline strings don't point to themselves, so swapping the bytes is enough
+        char temp[sizeof(small)];
+        memcpy(temp, small, sizeof(small));
+        memcpy(small, str.small, sizeof(small));
+        memcpy(str.small, temp, sizeof(small));
     }
     return *this;
 }
 
 Str &Str::operator=(const Str &str) {
     if (this != &str) {
-        init(str.buf, str.len);
+        init(str.data(), str.size());
     }
     return *this;
 }
 
 bool Str::operator==(StrView v) const {
     if (v.size() != size()) return false;
-    return memcmp(buf, v.buf, size()) == 0;
+    return memcmp(data(), v.buf, size()) == 0;
 }
 
 bool Str::operator!=(StrView v) const {
     return !(*this == v);
 }
 
+// == STR BUILDER ======================================================================================================
+
+StrBuilder::StrBuilder(usize initial_cap) {
+    reserve(initial_cap);
+}
+
+StrBuilder::~StrBuilder() {
+    pk_free(buf);
+}
+
+void StrBuilder::reserve(usize extra) {
+    if (len + extra <= cap) return;
+    usize new_cap = math::max(len + extra, cap * 2);
+    // +1 for the null terminator
+    char *newbuf = (char *)pk_realloc(buf, new_cap + 1);
+    pk_assert(newbuf);
+    buf = newbuf;
+    cap = new_cap;
+}
+
+StrBuilder &StrBuilder::push(char c) {
+    reserve(1);
+    buf[len++] = c;
+    return *this;
+}
+
+StrBuilder &StrBuilder::push(StrView view) {
+    if (view.empty()) return *this;
+    reserve(view.len);
+    memcpy(buf + len, view.buf, view.len);
+    len += view.len;
+    return *this;
+}
+
+StrBuilder &StrBuilder::print(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    printv(fmt, args);
+    va_end(args);
+    return *this;
+}
+
+StrBuilder &StrBuilder::printv(const char *fmt, va_list args) {
+    va_list vcopy;
+    va_copy(vcopy, args);
+    int written = vsnprintf(nullptr, 0, fmt, vcopy);
+    va_end(vcopy);
+    if (written <= 0) {
+        return *this;
+    }
+
+    reserve((usize)written);
+    vsnprintf(buf + len, (usize)written + 1, fmt, args);
+    len += (usize)written;
+    return *this;
+}
+
+StrView StrBuilder::view() const {
+    return StrView(buf, len);
+}
+
+Str StrBuilder::finish() {
+    Str out;
+    if (len <= Str::kmax_small) {
+        out.setSmall(buf ? buf : "", len);
+        pk_free(buf);
+    }
+    else {
+        buf[len] = '\0';
+        out.setLarge(buf, len, cap, Str::Heap);
+    }
+    buf = nullptr;
+    len = cap = 0;
+    return out;
+}
+
 StrView::StrView(const char *cstr) {
     if (cstr) {
         init(cstr, strlen(cstr));
@@ -568,72 +910,59 @@ bool StrView::endsWith(StrView view) {
 }
 
 bool StrView::contains(char c) {
-    for(usize i = 0; i < len; ++i) {
-        if(buf[i] == c) return true;
-    }
-    return false;
+    return StrUtils::findChar(buf, len, c) != len;
 }
 
 bool StrView::contains(StrView view) {
-    if(len < view.len) return false;
-    if (len == view.len) return *this == view;
-    usize end = len - view.len + 1;
-    for(usize i = 0; i < end; ++i) {
-        if(memcmp(buf + i, view.buf, view.len) == 0) return true;
-    }
-    return false;
+    if (view.empty()) return true;
+    return StrUtils::findSub(buf, len, view.buf, view.len) != len;
 }
 
 usize StrView::find(char c, usize from) {
-    for(usize i = from; i < len; ++i) {
-        if(buf[i] == c) return i;
-    }
-    return SIZE_MAX;
+    if (from >= len) return SIZE_MAX;
+    usize index = StrUtils::findChar(buf + from, len - from, c);
+    return index == (len - from) ? SIZE_MAX : from + index;
 }
 
 usize StrView::find(StrView view, usize from) {
-    if(len < view.len) return SIZE_MAX;
-    usize end = len - view.len;
-    for(usize i = from; i < end; ++i) {
-        if(memcmp(buf + i, view.buf, view.len) == 0) return i;
-    }
-    return SIZE_MAX;
+    if (from > len) return SIZE_MAX;
+    if (view.empty()) return from;
+    usize index = StrUtils::findSub(buf + from, len - from, view.buf, view.len);
+    return index == (len - from) ? SIZE_MAX : from + index;
 }
 
-usize StrView::rfind(char c, isize from_end) {
-    const char *end = buf + len - from_end;
-    if (end > (buf + len)) return SIZE_MAX;
-
-    for(; end >= buf; --end) {
-        if(*end == c) return (end - buf);
-    }
+// how many chars from the start are left to search
+static usize strview__search_len(usize len, isize from_end) {
+    usize skip = from_end < 0 ? (usize)(-(from_end + 1)) : (usize)from_end;
+    return skip < len ? len - skip : 0;
+}
 
-    return SIZE_MAX;
+usize StrView::rfind(char c, isize from_end) {
+    usize search_len = strview__search_len(len, from_end);
+    usize index = StrUtils::rfindChar(buf, search_len, c);
+    return index == search_len ? SIZE_MAX : index;
 }
 
 usize StrView::rfind(StrView view, isize from_end) {
-    if(view.len > len) {
-        return SIZE_MAX;
-    }
-
-    from_end -= view.len;
-    const char *end = buf + len - from_end;
-    if (end > (buf + len)) return SIZE_MAX;
-
-    for(; end >= buf; --end) {
-        if(memcmp(end, view.buf, view.len) == 0) return (end - buf);
+    usize search_len = strview__search_len(len, from_end);
+    if (view.len > search_len) return SIZE_MAX;
+    if (view.empty()) return search_len;
+
+    // look for the first char, then check the rest
+    usize end = search_len - view.len + 1;
+    while (end > 0) {
+        usize index = StrUtils::rfindChar(buf, end, view.buf[0]);
+        if (index == end) break;
+        if (memcmp(buf + index, view.buf, view.len) == 0) return index;
+        end = index;
     }
     return SIZE_MAX;
 }
 
 usize StrView::findFirstOf(StrView view, usize from) {
-    if(len < view.len) return SIZE_MAX;
-    for(usize i = from; i < len; ++i) {
-        for(usize j = 0; j < view.len; ++j) {
-            if(buf[i] == view.buf[j]) return i;
-        }
-    }
-    return SIZE_MAX;
+    if (from >= len) return SIZE_MAX;
+    usize index = StrUtils::findAnyOf(buf + from, len - from, view.buf, view.len);
+    return index == (len - from) ? SIZE_MAX : from + index;
 }
 
 usize StrView::findLastOf(StrView view, isize from_end) {
@@ -692,8 +1021,8 @@ usize StrView::findLastNotOf(StrView view, isize from_end) {
     return SIZE_MAX;
 }
 
-u32 StrView::hash() const {
-    return hashFnv132(buf, len);
+u64 StrView::hash() const {
+    return hashBytes(buf, len);
 }
 
 const char *StrView::data() {
@@ -740,10 +1069,10 @@ bool StrView::operator!=(StrView v) const {
     return !(*this == v);
 }
 
-u32 hash_impl(const Str &v) {
-    return hashFnv132(v.data(), v.size());
+u64 hash_impl(const Str &v) {
+    return hashBytes(v.data(), v.size());
 }
 
-u32 hash_impl(const StrView &v) {
-    return hashFnv132(v.buf, v.len);
+u64 hash_impl(const StrView &v) {
+    return hashBytes(v.buf, v.len);
 }
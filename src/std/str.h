@@ -19,17 +19,32 @@ namespace StrUtils {
 
     bool ansiToWide(const char *cstr, usize cstr_len, wchar_t *buf, usize buflen, usize *outlen = nullptr);
     bool wideToAnsi(const wchar_t *wstr, usize wstr_len, char *buf, usize buflen, usize *outlen = nullptr);
+
+    // search helpers used by StrView and InStream, they check 16 (SSE2) or 32 (AVX2) chars at
+    // a time when the target has them. they all return len if nothing is found
+    usize findChar(const char *buf, usize len, char c);
+    usize rfindChar(const char *buf, usize len, char c);
+    // first char that is any of the chars in set
+    usize findAnyOf(const char *buf, usize len, const char *set, usize set_len);
+    usize findSub(const char *buf, usize len, const char *sub, usize sub_len);
+    // first char that isn't whitespace (' ', '\t', '\n', '\v', '\f', '\r')
+    usize skipWhitespace(const char *buf, usize len);
 } // namespace StrUtils
 
+// strings of up to kmax_small chars are stored inline, longer ones are allocated with pk_malloc
+// or live in an arena. the last byte tells which one it is, so checking is just a load and a mask
 struct Str {
+    static constexpr usize kmax_small = 22;
+
     Str() = default;
     Str(const char *cstr);
     Str(const char *cstr, usize cstr_len);
     Str(StrView view);
-    Str(Str &&str);
+    Str(Str &&str) noexcept;
     Str(const Str &str);
     ~Str();
     
+    // arena strings are never stored inline, so views of them stay valid if the Str is moved
     Str(Arena &arena, const char *cstr);
     Str(Arena &arena, const char *cstr, usize cstr_len);
     Str(Arena &arena, StrView view);
@@ -43,14 +58,20 @@ struct Str {
 
     void init(const char *cstr, usize cstr_len);
     void init(Arena &arena, const char *cstr, usize cstr_len);
+    // takes ownership of a null terminated buffer allocated with pk_malloc
     void moveFrom(char *str, usize str_len);
+    // uses a null terminated buffer without owning it, it has to outlive the Str (e.g. arena memory)
+    void borrowFrom(char *str, usize str_len);
     Str dup(Arena &arena) const;
     void destroy();
+    // the new chars are zeroed
     void resize(usize new_len);
     void resize(Arena &arena, usize new_len);
+    // makes room for new_cap chars, anything bigger than kmax_small moves the string to the heap
+    void reserve(usize new_cap);
 
     void replace(char from, char to);
-    bool empty() const;
+    bool empty() const { return size() == 0; }
     StrView sub(usize from = 0, usize to = -1);
     void lower();
     void upper();
@@ -59,13 +80,16 @@ struct Str {
     Str toLower(Arena &arena) const;
     Str toUpper(Arena &arena) const;
 
-    char *data();
-    const char *data() const;
-    const char *cstr() const;
-    usize size() const;
-    bool isOwned() const;
+    char *data()             { return kind() == Small ? small : large.buf; }
+    const char *data() const { return kind() == Small ? small : large.buf; }
+    const char *cstr() const { return data(); }
+    usize size() const       { return kind() == Small ? (usize)tag() : large.len; }
+    usize capacity() const;
+    // false if the memory belongs to someone else, like an arena
+    bool isOwned() const     { return kind() != Borrowed; }
+    bool isInline() const    { return kind() == Small; }
 
-    u32 hash() const;
+    u64 hash() const;
 
     char *begin();
     char *end();
@@ -79,18 +103,65 @@ struct Str {
     const char &front() const;
     const char &operator[](usize index) const;
 
-    Str &operator=(Str &&str);
+    Str &operator=(Str &&str) noexcept;
     Str &operator=(const Str &str);
 
     bool operator==(StrView v) const;
     bool operator!=(StrView v) const;
 
 private:
-    // we're doing some funky stuff to support both owned and
-    // not owned strings, so don't access these directly
+    friend struct StrBuilder;
+
+    // stored in the top two bits of the last byte
+    enum Kind : u8 {
+        Small    = 0,      // inline, the rest of the last byte is the size
+        Heap     = 1 << 6, // allocated with pk_malloc, freed on destroy
+        Borrowed = 1 << 7, // someone else's memory, usually an arena
+    };
+
+    struct Large {
+        char *buf;
+        usize len;
+        // capacity in the low 7 bytes, the last one is the tag (little endian only)
+        usize cap_tag;
+    };
+
+    u8 tag() const { return (u8)small[sizeof(Large) - 1]; }
+    Kind kind() const { return (Kind)(tag() & 0xC0); }
+    void setSmall(const char *cstr, usize cstr_len);
+    void setLarge(char *buf, usize buf_len, usize buf_cap, Kind kind);
+
+    union {
+        Large large;
+        // zero is an empty inline string
+        char small[sizeof(Large)] = {};
+    };
+};
+
+// builds a Str piece by piece. reserve the final size up front and it only allocates
+// once, results short enough to fit inline in the Str don't keep the allocation
+struct StrBuilder {
+    StrBuilder() = default;
+    explicit StrBuilder(usize initial_cap);
+    StrBuilder(const StrBuilder &) = delete;
+    ~StrBuilder();
+
+    // makes room for at least extra more chars
+    void reserve(usize extra);
+
+    StrBuilder &push(char c);
+    StrBuilder &push(StrView view);
+    StrBuilder &print(const char *fmt, ...);
+    StrBuilder &printv(const char *fmt, va_list args);
+
+    usize size() const { return len; }
+    StrView view() const;
+    // moves the string out, the builder is empty afterwards
+    Str finish();
 
     char *buf = nullptr;
     usize len = 0;
+    usize cap = 0;
 };
 
 struct StrView {
@@ -119,6 +190,8 @@ struct StrView {
     bool contains(StrView view);
     usize find(char c, usize from = 0);
     usize find(StrView view, usize from = 0);
+    // from_end is how many chars to skip from the end, negative values count from the
+    // end instead (-1 is the last char)
     usize rfind(char c, isize from_end = -1);
     usize rfind(StrView view, isize from_end = -1);
     usize findFirstOf(StrView view, usize from = 0);
@@ -128,7 +201,7 @@ struct StrView {
     usize findLastNot(char c, isize from_end = -1);
     usize findLastNotOf(StrView view, isize from_end = -1);
 
-    u32 hash() const;
+    u64 hash() const;
 
     const char *data();
     const char *cstr() const;
@@ -268,11 +341,11 @@ struct StaticStr {
         len = new_len;
     }
 
-    Str dup(Arena &arena)                const { return StrView(buf, len).dup(); }
+    Str dup(Arena &arena)                const { return StrView(buf, len).dup(arena); }
     StrView sub(usize from = 0, usize to = -1) { return StrView(buf, len).sub(from, to); }
     bool empty()                         const { return len == 0; }
 
-    u32 hash()   const { return StrView(buf, len).hash(); }
+    u64 hash()   const { return StrView(buf, len).hash(); }
 
     const char *data()        { return buf; }
     const char *cstr() const  { return buf; }
@@ -301,7 +374,7 @@ struct StaticStr {
     usize len;
 };
 
-u32 hash_impl(const Str &v);
-u32 hash_impl(const StrView &v);
+u64 hash_impl(const Str &v);
+u64 hash_impl(const StrView &v);
 template<usize N>
-u32 hash_impl(const StaticStr<N> &v) { return hash_impl(StrView(v.buf, v.len)); }
\ No newline at end of file
+u64 hash_impl(const StaticStr<N> &v) { return hash_impl(StrView(v.buf, v.len)); }
\ No newline at end of file
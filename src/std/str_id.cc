@@ -0,0 +1,64 @@
+#include "str_id.h"
+
+#include <string.h>
+
+#include "arena.h"
+#include "hashmap.h"
+#include "threads.h"
+#include "logging.h"
+
+struct StrInterner {
+    // the strings are never freed, they live as long as the program
+    Arena arena = Arena::make(mb(64), Arena::Virtual);
+    HashMap<StrId, StrView> strings;
+    ReadWriteLock lock;
+};
+
+// constructed on first use, ids can be interned from other static initialisers
+static StrInterner &str_id__interner() {
+    static StrInterner interner;
+    return interner;
+}
+
+StrId StrId::intern(StrView str) {
+    StrId id;
+    id.id = hashBytes(str.buf, str.len);
+
+    StrInterner &interner = str_id__interner();
+
+    interner.lock.lockRead();
+    const StrView *existing = interner.strings.get(id);
+    bool found = existing != nullptr;
+    if (found && *existing != str) {
+        // two names would silently be the same key everywhere, there's no way to recover
+        fatal("StrId collision between \"%.*s\" and \"%.*s\"", (int)existing->len, existing->buf, (int)str.len, str.buf);
+    }
+    interner.lock.unlockRead();
+
+    if (found) {
+        return id;
+    }
+
+    interner.lock.lockWrite();
+    // somebody else might have added it while we didn't hold the lock
+    if (!interner.strings.contains(id)) {
+        char *buf = interner.arena.alloc<char>(str.len + 1, Arena::NoZero);
+        memcpy(buf, str.buf, str.len);
+        buf[str.len] = '\0';
+        interner.strings.push(id, StrView(buf, str.len));
+    }
+    interner.lock.unlockWrite();
+
+    return id;
+}
+
+StrView StrId::str() const {
+    StrInterner &interner = str_id__interner();
+
+    interner.lock.lockRead();
+    const StrView *str = interner.strings.get(*this);
+    StrView out = str ? *str : StrView();
+    interner.lock.unlockRead();
+
+    return out;
+}
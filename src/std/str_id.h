@@ -0,0 +1,36 @@
+#pragma once
+
+#include "common.h"
+#include "str.h"
+#include "hash.h"
+
+// interned string. the id is the 64 bit hash of the string, so comparing two ids is a single
+// integer compare and they can be used as hash map keys without hashing the string again.
+// literals are hashed at compile time, intern also keeps a copy of the string in a global
+// arena so it can be found from the id with str().
+// the id has to be the hash (not an index into the table) for literals to work without
+// interning them first, and 64 bits make collisions practically impossible. if two interned
+// strings ever do collide it's fatal
+struct StrId {
+    constexpr StrId() = default;
+    template<usize N>
+    consteval StrId(const char (&literal)[N]) : id(hashBytesConst(literal, N - 1)) {}
+
+    // thread safe, interning the same string twice returns the same id
+    static StrId intern(StrView str);
+
+    // the interned string, empty if the id never went through intern
+    StrView str() const;
+
+    bool isValid() const { return id != 0; }
+    u64 hash() const { return id; }
+
+    constexpr bool operator==(const StrId &other) const { return id == other.id; }
+    constexpr bool operator!=(const StrId &other) const { return id != other.id; }
+
+    u64 id = 0;
+};
+
+inline u64 hash_impl(const StrId &v) {
+    return v.id;
+}
@@ -1,6 +1,5 @@
 #include "stream.h"
 
-#include <ctype.h>
 #include <math.h> // HUGE_VALF
 #include <stdio.h>
 
@@ -39,21 +38,12 @@ char InStream::peek() const {
 
 void InStream::ignore(char delim) {
     if (isFinished()) return;
-    for(usize i = cur - start; 
-        i < size && *cur != delim; 
-        ++i, ++cur);
+    cur += StrUtils::findChar(cur, remaining(), delim);
 }
 
 void InStream::ignore(StrView view) {
-    const char *end = start + size;
-    while (
-        ((cur + view.len) < end) && 
-        view != StrView(cur, view.len)
-    ) {
-        ++cur;
-        // search the first character
-        ignore(view.buf[0]);
-    }
+    if (isFinished()) return;
+    cur += StrUtils::findSub(cur, remaining(), view.buf, view.len);
 }
 
 void InStream::ignoreAndSkip(char delim) {
@@ -72,9 +62,8 @@ void InStream::skip(usize n) {
 }
 
 void InStream::skipWhitespace() {
-    for (const char *end = start + size; 
-         cur < end && isspace(*cur); 
-         ++cur); 
+    if (isFinished()) return;
+    cur += StrUtils::skipWhitespace(cur, remaining());
 }
 
 bool InStream::expect(char c) {
@@ -277,11 +266,8 @@ StrView InStream::getView(char delim) {
 
 StrView InStream::getViewEither(StrView view) {
     const char *from = cur;
-    const char *end = start + size;
-    for(; cur < end; ++cur) {
-        if (view.contains(*cur)) {
-            break;
-        }
+    if (!isFinished()) {
+        cur += StrUtils::findAnyOf(cur, remaining(), view.buf, view.len);
     }
     usize len = cur - from;
     return { from, len };
@@ -462,7 +448,8 @@ void OutStreamArena::finish() {
 Str OutStreamArena::asStr() {
     finish();
     Str out;
-    out.moveFrom(buf, len);
+    // the memory belongs to the arena, and the size doesn't include the null terminator
+    out.borrowFrom(buf, len - 1);
     buf = nullptr;
     len = 0;
     return out;
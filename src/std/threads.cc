@@ -1,11 +1,14 @@
 #include "threads.h"
 
-#define WIN32_LEAN_AND_MEAN
-#include <windows.h>
-
 #include "mem.h"
 #include "logging.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_IX86)
+#include <emmintrin.h>
+#endif
+
+// platform generic functions
+
 // THREADS ////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 Thread::Thread(Func fn, void *userdata) {
@@ -24,12 +27,80 @@ Thread Thread::create(Func fn, void *userdata) {
     return Thread(fn, userdata);
 }
 
-Thread Thread::current() {
-    Thread out;
-    out.handle = (uptr)GetCurrentThread();
-    return out;
+void Thread::pause() {
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_IX86)
+    _mm_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+bool Thread::detach() {
+    if (!isValid()) return false;
+    return close();
+}
+
+Thread &Thread::operator=(Thread &&t) {
+    if (this != &t) {
+        mem::swap(handle, t.handle);
+    }
+    return *this;
+}
+
+// MUTEXES ////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+Mutex::Mutex() {
+    init();
+}
+
+Mutex::~Mutex() {
+    cleanup();
+}
+
+Mutex::Mutex(Mutex &&m) {
+    *this = mem::move(m);
+}
+
+bool Mutex::isValid() const {
+    return handle;
+}
+
+Mutex &Mutex::operator=(Mutex &&m) {
+    if (this != &m) {
+        mem::swap(handle, m.handle);
+    }
+    return *this;
+}
+
+// CONDITIONAL VARIABLES //////////////////////////////////////////////////////////////////////////////////////////
+
+CondVar::CondVar() {
+    init();
+}
+
+CondVar::~CondVar() {
+    cleanup();
+}
+
+// READ WRITE LOCKS ///////////////////////////////////////////////////////////////////////////////////////////////
+
+ReadWriteLock::ReadWriteLock() {
+    init();
+}
+
+ReadWriteLock::~ReadWriteLock() {
+    cleanup();
 }
 
+// platform specific functions
+
+#if PK_WINDOWS
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+// THREADS ////////////////////////////////////////////////////////////////////////////////////////////////////////
+
 uptr Thread::currentId() {
     return (uptr)GetCurrentThreadId();
 }
@@ -79,11 +150,6 @@ bool Thread::close() {
     return closed;
 }
 
-bool Thread::detach() {
-    if (!isValid()) return false;
-    return close();
-}
-
 bool Thread::join(int *out_code) {
     if (!isValid()) return false;
     WaitForSingleObject((HANDLE)handle, INFINITE);
@@ -100,26 +166,18 @@ uptr Thread::getId() const {
     return GetThreadId((HANDLE)handle);
 }
 
-Thread &Thread::operator=(Thread &&t) {
-    if (this != &t) {
-        mem::swap(handle, t.handle);
-    }
-    return *this;
-}
-
-// MUTEXES ////////////////////////////////////////////////////////////////////////////////////////////////////////
-
-Mutex::Mutex() {
-    init();
+uint Thread::getCoreCount() {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (uint)info.dwNumberOfProcessors;
 }
 
-Mutex::~Mutex() {
-    cleanup();
+bool Thread::setAffinity(uint core) {
+    if (!isValid() || core >= sizeof(DWORD_PTR) * 8) return false;
+    return SetThreadAffinityMask((HANDLE)handle, (DWORD_PTR)1 << core) != 0;
 }
 
-Mutex::Mutex(Mutex &&m) {
-    *this = mem::move(m);
-}
+// MUTEXES ////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 void Mutex::init() {
     CRITICAL_SECTION *crit_sect = (CRITICAL_SECTION *)pk_malloc(sizeof(CRITICAL_SECTION));
@@ -139,10 +197,6 @@ void Mutex::cleanup() {
     handle = 0;
 }
 
-bool Mutex::isValid() const {
-    return handle;
-}
-
 bool Mutex::lock() {
      if (!isValid()) { warn("mutex::lock: mutex is not valid"); return false; }
      EnterCriticalSection((CRITICAL_SECTION *)handle);
@@ -160,25 +214,19 @@ bool Mutex::unlock() {
     return true;
 }
 
-Mutex &Mutex::operator=(Mutex &&m) {
-    if (this != &m) {
-        mem::swap(handle, m.handle);
-    }
-    return *this;
-}
-
 // CONDITIONAL VARIABLES //////////////////////////////////////////////////////////////////////////////////////////
 
-CondVar::CondVar() {
-    init();
-}
-
 void CondVar::init() {
     static_assert(sizeof(CONDITION_VARIABLE) <= sizeof(handle));
     CONDITION_VARIABLE cond = CONDITION_VARIABLE_INIT;
     memcpy(&handle, &cond, sizeof(cond));
 }
 
+void CondVar::cleanup() {
+    // win32 condition variables don't need to be destroyed
+    handle = 0;
+}
+
 void CondVar::wake() {
     WakeConditionVariable((CONDITION_VARIABLE *)&handle);
 }
@@ -194,3 +242,430 @@ void CondVar::wait(const Mutex &mtx) {
 void CondVar::waitTimed(const Mutex &mtx, uint ms) {
     SleepConditionVariableCS((CONDITION_VARIABLE *)&handle, (CRITICAL_SECTION *)mtx.handle, ms);
 }
+
+// READ WRITE LOCKS ///////////////////////////////////////////////////////////////////////////////////////////////
+
+void ReadWriteLock::init() {
+    static_assert(sizeof(SRWLOCK) <= sizeof(handle));
+    SRWLOCK lock = SRWLOCK_INIT;
+    memcpy(&handle, &lock, sizeof(lock));
+}
+
+void ReadWriteLock::cleanup() {
+    // slim reader/writer locks don't need to be destroyed
+    handle = 0;
+}
+
+bool ReadWriteLock::isValid() const {
+    // SRWLOCK_INIT is zero, so there's no way to tell
+    return true;
+}
+
+void ReadWriteLock::lockRead() {
+    AcquireSRWLockShared((SRWLOCK *)&handle);
+}
+
+bool ReadWriteLock::tryLockRead() {
+    return TryAcquireSRWLockShared((SRWLOCK *)&handle);
+}
+
+void ReadWriteLock::unlockRead() {
+    ReleaseSRWLockShared((SRWLOCK *)&handle);
+}
+
+void ReadWriteLock::lockWrite() {
+    AcquireSRWLockExclusive((SRWLOCK *)&handle);
+}
+
+bool ReadWriteLock::tryLockWrite() {
+    return TryAcquireSRWLockExclusive((SRWLOCK *)&handle);
+}
+
+void ReadWriteLock::unlockWrite() {
+    ReleaseSRWLockExclusive((SRWLOCK *)&handle);
+}
+
+// FUTEX //////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace futex {
+    bool wait(std::atomic<u32> &value, u32 expected, uint ms) {
+        static_assert(sizeof(std::atomic<u32>) == sizeof(u32));
+        BOOL result = WaitOnAddress(&value, &expected, sizeof(u32), ms == UINT_MAX ? INFINITE : (DWORD)ms);
+        return result || GetLastError() != ERROR_TIMEOUT;
+    }
+
+    void wakeOne(std::atomic<u32> &value) {
+        WakeByAddressSingle(&value);
+    }
+
+    void wakeAll(std::atomic<u32> &value) {
+        WakeByAddressAll(&value);
+    }
+} // namespace futex
+
+#endif
+
+#if PK_POSIX
+
+#include <pthread.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sched.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+// pthread functions have a different signature than our Thread::Func, so we
+// go through this trampoline which also keeps the exit code and finished flag
+struct thr__start_data {
+    Thread::Func *fn;
+    void *userdata;
+    std::atomic<bool> finished;
+};
+
+static void *thr__trampoline(void *udata) {
+    thr__start_data *data = (thr__start_data *)udata;
+    int code = data->fn(data->userdata);
+    data->finished = true;
+    return (void *)(iptr)code;
+}
+
+static void thr__get_abs_time(struct timespec &ts, uint ms) {
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += ms / 1000;
+    ts.tv_nsec += (long)(ms % 1000) * 1000000;
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec += 1;
+        ts.tv_nsec -= 1000000000;
+    }
+}
+
+// THREADS ////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// pthread_t is opaque, we store a pointer to this in the handle instead
+struct thr__posix_thread {
+    pthread_t thread;
+    thr__start_data start;
+};
+
+uptr Thread::currentId() {
+    return (uptr)pthread_self();
+}
+
+void Thread::exit(int code) {
+    pthread_exit((void *)(iptr)code);
+}
+
+bool Thread::joinAll(Slice<Thread> threads) {
+    bool joined = true;
+    for (const Thread &t : threads) {
+        if (!t.isValid()) {
+            err("not all threads are valid");
+            joined = false;
+            continue;
+        }
+        // join releases the handle, so we need a mutable thread here
+        joined &= ((Thread &)t).join();
+    }
+    return joined;
+}
+
+bool Thread::areAllFinished(Slice<Thread> threads) {
+    for (const Thread &t : threads) {
+        if (!t.isValid()) continue;
+        thr__posix_thread *thr = (thr__posix_thread *)t.handle;
+        if (!thr->start.finished) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Thread::init(Func fn, void *userdata) {
+    thr__posix_thread *thr = (thr__posix_thread *)pk_calloc(sizeof(thr__posix_thread), 1);
+    if (!thr) {
+        fatal("could not allocate thread");
+    }
+
+    thr->start.fn = fn;
+    thr->start.userdata = userdata;
+    thr->start.finished = false;
+
+    int res = pthread_create(&thr->thread, nullptr, thr__trampoline, &thr->start);
+    if (res != 0) {
+        err("could not create thread: %s", strerror(res));
+        pk_free(thr);
+        handle = 0;
+        return;
+    }
+
+    handle = (uptr)thr;
+}
+
+bool Thread::isValid() const {
+    return handle != 0;
+}
+
+bool Thread::close() {
+    if (!isValid()) return false;
+    thr__posix_thread *thr = (thr__posix_thread *)handle;
+    // a thread that was never joined keeps running on its own
+    bool closed = pthread_detach(thr->thread) == 0;
+    if (thr->start.finished) {
+        pk_free(thr);
+    }
+    // otherwise the thread still needs the start data, we leak the few bytes
+    // instead of racing against the trampoline
+    handle = 0;
+    return closed;
+}
+
+bool Thread::join(int *out_code) {
+    if (!isValid()) return false;
+    thr__posix_thread *thr = (thr__posix_thread *)handle;
+
+    void *exit_code = nullptr;
+    int res = pthread_join(thr->thread, &exit_code);
+    if (res != 0) {
+        err("could not join thread: %s", strerror(res));
+        return false;
+    }
+
+    if (out_code) {
+        *out_code = (int)(iptr)exit_code;
+    }
+
+    pk_free(thr);
+    handle = 0;
+    return true;
+}
+
+uptr Thread::getId() const {
+    if (!isValid()) return SIZE_MAX;
+    return (uptr)((thr__posix_thread *)handle)->thread;
+}
+
+uint Thread::getCoreCount() {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (uint)count : 1;
+}
+
+bool Thread::setAffinity(uint core) {
+    if (!isValid()) return false;
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    thr__posix_thread *thr = (thr__posix_thread *)handle;
+    return pthread_setaffinity_np(thr->thread, sizeof(set), &set) == 0;
+#else
+    // macOS only has affinity hints, not worth it
+    (void)core;
+    return false;
+#endif
+}
+
+// MUTEXES ////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void Mutex::init() {
+    pthread_mutex_t *mtx = (pthread_mutex_t *)pk_malloc(sizeof(pthread_mutex_t));
+    if (mtx) {
+        pthread_mutex_init(mtx, nullptr);
+    }
+    else {
+        fatal("mutex is null");
+    }
+    handle = (uptr)mtx;
+}
+
+void Mutex::cleanup() {
+    pthread_mutex_t *mtx = (pthread_mutex_t *)handle;
+    if (mtx) {
+        pthread_mutex_destroy(mtx);
+        pk_free(mtx);
+    }
+    handle = 0;
+}
+
+bool Mutex::lock() {
+    if (!isValid()) { warn("mutex::lock: mutex is not valid"); return false; }
+    return pthread_mutex_lock((pthread_mutex_t *)handle) == 0;
+}
+
+bool Mutex::tryLock() {
+    if (!isValid()) { warn("mutex::tryLock: mutex is not valid"); return false; }
+    return pthread_mutex_trylock((pthread_mutex_t *)handle) == 0;
+}
+
+bool Mutex::unlock() {
+    if (!isValid()) { warn("mutex::unlock: mutex is not valid"); return false; }
+    return pthread_mutex_unlock((pthread_mutex_t *)handle) == 0;
+}
+
+// CONDITIONAL VARIABLES //////////////////////////////////////////////////////////////////////////////////////////
+
+void CondVar::init() {
+    pthread_cond_t *cond = (pthread_cond_t *)pk_malloc(sizeof(pthread_cond_t));
+    if (cond) {
+        pthread_cond_init(cond, nullptr);
+    }
+    else {
+        fatal("condition variable is null");
+    }
+    handle = (uptr)cond;
+}
+
+void CondVar::cleanup() {
+    pthread_cond_t *cond = (pthread_cond_t *)handle;
+    if (cond) {
+        pthread_cond_destroy(cond);
+        pk_free(cond);
+    }
+    handle = 0;
+}
+
+void CondVar::wake() {
+    pthread_cond_signal((pthread_cond_t *)handle);
+}
+
+void CondVar::wakeAll() {
+    pthread_cond_broadcast((pthread_cond_t *)handle);
+}
+
+void CondVar::wait(const Mutex &mtx) {
+    pthread_cond_wait((pthread_cond_t *)handle, (pthread_mutex_t *)mtx.handle);
+}
+
+void CondVar::waitTimed(const Mutex &mtx, uint ms) {
+    struct timespec ts;
+    thr__get_abs_time(ts, ms);
+    pthread_cond_timedwait((pthread_cond_t *)handle, (pthread_mutex_t *)mtx.handle, &ts);
+}
+
+// READ WRITE LOCKS ///////////////////////////////////////////////////////////////////////////////////////////////
+
+void ReadWriteLock::init() {
+    pthread_rwlock_t *lock = (pthread_rwlock_t *)pk_malloc(sizeof(pthread_rwlock_t));
+    if (lock) {
+        pthread_rwlock_init(lock, nullptr);
+    }
+    else {
+        fatal("read write lock is null");
+    }
+    handle = (uptr)lock;
+}
+
+void ReadWriteLock::cleanup() {
+    pthread_rwlock_t *lock = (pthread_rwlock_t *)handle;
+    if (lock) {
+        pthread_rwlock_destroy(lock);
+        pk_free(lock);
+    }
+    handle = 0;
+}
+
+bool ReadWriteLock::isValid() const {
+    return handle;
+}
+
+void ReadWriteLock::lockRead() {
+    pthread_rwlock_rdlock((pthread_rwlock_t *)handle);
+}
+
+bool ReadWriteLock::tryLockRead() {
+    return pthread_rwlock_tryrdlock((pthread_rwlock_t *)handle) == 0;
+}
+
+void ReadWriteLock::unlockRead() {
+    pthread_rwlock_unlock((pthread_rwlock_t *)handle);
+}
+
+void ReadWriteLock::lockWrite() {
+    pthread_rwlock_wrlock((pthread_rwlock_t *)handle);
+}
+
+bool ReadWriteLock::tryLockWrite() {
+    return pthread_rwlock_trywrlock((pthread_rwlock_t *)handle) == 0;
+}
+
+void ReadWriteLock::unlockWrite() {
+    pthread_rwlock_unlock((pthread_rwlock_t *)handle);
+}
+
+// FUTEX //////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#if defined(__linux__)
+
+namespace futex {
+    bool wait(std::atomic<u32> &value, u32 expected, uint ms) {
+        static_assert(sizeof(std::atomic<u32>) == sizeof(u32));
+
+        struct timespec ts;
+        struct timespec *timeout = nullptr;
+        if (ms != UINT_MAX) {
+            // FUTEX_WAIT takes a relative timeout
+            ts.tv_sec = ms / 1000;
+            ts.tv_nsec = (long)(ms % 1000) * 1000000;
+            timeout = &ts;
+        }
+
+        long res = syscall(SYS_futex, (u32 *)&value, FUTEX_WAIT_PRIVATE, expected, timeout, nullptr, 0);
+        return res == 0 || errno != ETIMEDOUT;
+    }
+
+    void wakeOne(std::atomic<u32> &value) {
+        syscall(SYS_futex, (u32 *)&value, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+    }
+
+    void wakeAll(std::atomic<u32> &value) {
+        syscall(SYS_futex, (u32 *)&value, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+    }
+} // namespace futex
+
+#else
+
+// no futex on this platform, fallback to a global condition variable.
+// waiters recheck the value so spurious wakeups are fine
+
+static pthread_mutex_t futex__mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t futex__cond = PTHREAD_COND_INITIALIZER;
+
+namespace futex {
+    bool wait(std::atomic<u32> &value, u32 expected, uint ms) {
+        bool woken = true;
+        pthread_mutex_lock(&futex__mtx);
+        if (value.load() == expected) {
+            if (ms == UINT_MAX) {
+                pthread_cond_wait(&futex__cond, &futex__mtx);
+            }
+            else {
+                struct timespec ts;
+                thr__get_abs_time(ts, ms);
+                woken = pthread_cond_timedwait(&futex__cond, &futex__mtx, &ts) != ETIMEDOUT;
+            }
+        }
+        pthread_mutex_unlock(&futex__mtx);
+        return woken;
+    }
+
+    void wakeOne(std::atomic<u32> &value) {
+        // we can't target a single address, so wake everyone
+        wakeAll(value);
+    }
+
+    void wakeAll(std::atomic<u32> &value) {
+        pk_unused(value);
+        pthread_mutex_lock(&futex__mtx);
+        pthread_cond_broadcast(&futex__cond);
+        pthread_mutex_unlock(&futex__mtx);
+    }
+} // namespace futex
+
+#endif
+
+#endif
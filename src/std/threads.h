@@ -1,5 +1,7 @@
 #pragma once
 
+#include <atomic>
+
 #include "common.h"
 #include "slice.h"
 
@@ -12,11 +14,14 @@ struct Thread {
     Thread(Thread &&t);
 
     static Thread create(Func fn, void *userdata = nullptr);
-    static Thread current();
     static uptr currentId();
     static void exit(int code = 0);
+    // tells the cpu we're in a spin loop, call it in every busy wait iteration
+    static void pause();
     static bool joinAll(Slice<Thread> threads);
     static bool areAllFinished(Slice<Thread> threads);
+    // number of logical cores available to the process
+    static uint getCoreCount();
 
     void init(Func fn, void *userdata = nullptr);
 
@@ -25,6 +30,8 @@ struct Thread {
     bool detach();
     bool join(int *out_code = nullptr);
     uptr getId() const;
+    // restricts the thread to run only on one logical core
+    bool setAffinity(uint core);
 
     Thread &operator=(Thread &&t);
 
@@ -52,8 +59,10 @@ struct Mutex {
 
 struct CondVar {
     CondVar();
+    ~CondVar();
 
     void init();
+    void cleanup();
 
     void wake();
     void wakeAll();
@@ -65,7 +74,31 @@ struct CondVar {
 };
 
 struct ReadWriteLock {
+    ReadWriteLock();
+    ~ReadWriteLock();
+
+    void init();
+    void cleanup();
+
+    bool isValid() const;
+
+    // shared access, any number of readers can hold the lock at the same time
+    void lockRead();
+    bool tryLockRead();
+    void unlockRead();
+
+    // exclusive access
+    void lockWrite();
+    bool tryLockWrite();
+    void unlockWrite();
+
+    uptr handle = 0;
+};
 
-    
-    Mutex write_mtx;
-};
\ No newline at end of file
+// wait on the value of an address, this is a futex on linux and WaitOnAddress on win32
+namespace futex {
+    // sleeps while value == expected, returns false if it timed out
+    bool wait(std::atomic<u32> &value, u32 expected, uint ms = UINT_MAX);
+    void wakeOne(std::atomic<u32> &value);
+    void wakeAll(std::atomic<u32> &value);
+} // namespace futex
@@ -79,6 +79,21 @@ namespace vmem {
 
         return true;
     }
+
+    bool decommit(void *ptr, usize num_of_pages) {
+        if (!VirtualFree(ptr, num_of_pages * getPageSize(), MEM_DECOMMIT)) {
+            err("failed to decommit memory: %u", GetLastError());
+            return false;
+        }
+        return true;
+    }
+
+    bool adviseHugePages(void *ptr, usize size) {
+        // large pages need special privileges and have to be committed up front
+        pk_unused(ptr);
+        pk_unused(size);
+        return false;
+    }
 } // namespace vmem
 
 static void vmem__update_page_size(void) {
@@ -96,33 +111,44 @@ static void vmem__update_page_size(void) {
 #include <errno.h>
 #include <string.h>
 
+// munmap needs the size of the mapping, so we keep it in a read/write page
+// just before the memory we return
 struct vmem__header {
     usize len;
 };
 
 namespace vmem {
-    void *init(usize size, usize *padded_size) {
-        size += sizeof(vmem__header);
+    void *init(usize size, usize *out_padded_size) {
         usize alloc_size = padToPage(size);
+        usize header_size = getPageSize();
 
-        vmem__header *header = mmap(NULL, alloc_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        // PROT_NONE only reserves the address space, commit makes the pages usable
+        byte *base = (byte *)mmap(nullptr, header_size + alloc_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
 
-        if (header == MAP_FAILED) {
-            fatal("could not map %zu memory: %s", size, strerror(errno));
+        if (base == MAP_FAILED) {
+            err("could not reserve %zu bytes: %s", size, strerror(errno));
+            return nullptr;
         }
 
-        if (padded_size) {
-            *padded_size = alloc_size;
+        if (mprotect(base, header_size, PROT_READ | PROT_WRITE) != 0) {
+            err("could not commit the vmem header: %s", strerror(errno));
+            munmap(base, header_size + alloc_size);
+            return nullptr;
         }
 
-        header->len = alloc_size;
+        vmem__header *header = (vmem__header *)base;
+        header->len = header_size + alloc_size;
 
-        return header + 1;
+        if (out_padded_size) {
+            *out_padded_size = alloc_size;
+        }
+
+        return base + header_size;
     }
 
     bool release(void *base_ptr) {
         if (!base_ptr) return false;
-        vmem__header *header = (vmem__header *)base_ptr - 1;
+        vmem__header *header = (vmem__header *)((byte *)base_ptr - getPageSize());
 
         int res = munmap(header, header->len);
         if (res == -1) {
@@ -132,11 +158,46 @@ namespace vmem {
     }
 
     bool commit(void *ptr, usize num_of_pages) {
-        // mmap doesn't need a commit step
-        pk_unused(ptr);
-        pk_unused(num_of_pages);
+        if (page_size == 0) {
+            warn("commiting memory but page size wasn't initialised");
+            return false;
+        }
+
+        if (mprotect(ptr, num_of_pages * page_size, PROT_READ | PROT_WRITE) != 0) {
+            err("failed to commit memory: %s", strerror(errno));
+            return false;
+        }
+
+        return true;
+    }
+
+    bool decommit(void *ptr, usize num_of_pages) {
+        usize len = num_of_pages * getPageSize();
+
+        // drop the physical pages first, the next commit gets zeroed pages
+        if (madvise(ptr, len, MADV_DONTNEED) != 0) {
+            err("failed to decommit memory: %s", strerror(errno));
+            return false;
+        }
+
+        if (mprotect(ptr, len, PROT_NONE) != 0) {
+            err("failed to protect decommitted memory: %s", strerror(errno));
+            return false;
+        }
+
         return true;
     }
+
+    bool adviseHugePages(void *ptr, usize size) {
+#if defined(MADV_HUGEPAGE)
+        // only the parts of the range that are 2MB aligned can use them
+        return madvise(ptr, padToPage(size), MADV_HUGEPAGE) == 0;
+#else
+        pk_unused(ptr);
+        pk_unused(size);
+        return false;
+#endif
+    }
 } // namespace vmem
 
 static void vmem__update_page_size(void) {
@@ -3,12 +3,16 @@
 #include "common.h"
 
 namespace vmem {
-    // reserve virtual memory, this doesn't actually commit the memory in win32
+    // reserve virtual memory, this doesn't actually commit the memory
     void *init(usize size, usize *out_padded_size = nullptr);
     // free the virtual memory
     bool release(void *base_ptr);
     // commit memory, ptr needs to be aligned to page size
     bool commit(void *ptr, usize num_of_pages);
+    // give the pages back to the os, they stay reserved and can be committed again
+    bool decommit(void *ptr, usize num_of_pages);
+    // ask the os to back the memory with huge pages, only does something on linux
+    bool adviseHugePages(void *ptr, usize size);
     // get the size of a page
     usize getPageSize(void);
     // pads the byte count to a page size
@@ -1,205 +1,330 @@
 #include "sort.h"
 
-// convert number of bits to number of bytes (e.g. 24 -> 3)
-constexpr u32 radix__bits_to_byte(u32 bits) {
-    return bits >> 3;
-}
+#include <string.h>
+
+#include "core/thread_pool.h"
+
+// below this many elements radixSortParallel just sorts on the calling thread
+static constexpr u32 radix__parallel_min = 1 << 16;
+static constexpr u32 radix__max_chunks = 64;
 
-static u32 radix__find_max(u32 *beg, u32 *end) {
-    u32 max = *beg;
-    for (; beg < end; ++beg) {
-        if (max < *beg) max = *beg;
+// == KEYS =============================================================================================================
+
+// the key as an unsigned integer that sorts the same way as the original
+template<SortKey ktype>
+static inline u64 radix__load_key(const byte *p) {
+    if constexpr (ktype == SortKey::U32) {
+        u32 v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+    else if constexpr (ktype == SortKey::U64) {
+        u64 v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+    else {
+        // flip every bit of negative numbers so they sort in reverse,
+        // and only the sign bit of positive ones so they come after
+        u32 v;
+        memcpy(&v, p, sizeof(v));
+        const u32 mask = (v & 0x80000000u) ? 0xFFFFFFFFu : 0x80000000u;
+        return v ^ mask;
     }
-    return max;
 }
 
-static u32 radix__find_max(u8 *beg, u8 *end, u32 stride) {
-    u32 max = *((u32 *)beg);
-    for (; beg < end; beg += stride) {
-        u32 v = *((u32 *)beg);
-        if (max < v) max = v;
+template<SortKey ktype>
+static constexpr u32 radix__pass_count = ktype == SortKey::U64 ? 8 : 4;
+
+// copies a record, kstride is 0 when it's only known at runtime
+template<u32 kstride>
+static inline void radix__copy(byte *dst, const byte *src, u32 stride) {
+    if constexpr (kstride) {
+        memcpy(dst, src, kstride);
+    }
+    else {
+        memcpy(dst, src, stride);
     }
-    return max;
 }
 
-void radixSort(u32 *buf, u32 len) {
-    Arena temp = Arena::make(sizeof(u32) * len, Arena::Malloc);
-    radixSort(buf, len, temp);
-}
-
-void radixSort(u32 *buf, u32 len, Arena scratch) {
-    u32 *helper = nullptr;
-    // bits sorted
-    u32 exp = 0;
-    // array of pointers to the helper array
-    u32 *point[256];
-    bool swap = false;
-
-    // Define std preliminary, constrain and expression to check if all bytes are sorted
-    // Set preliminary according to size
-    const u32 preliminary = (len > 100) ? 100 : (len >> 3);
-    
-    // If we found a integer with more than 24 bits in preliminar,
-    // will have to sort all bytes either way, so max = max_uint
-    u32 max = radix__find_max(buf + 1, buf + preliminary);
-    if(max <= (UINT_MAX >> 8)) {
-        u32 new_max = radix__find_max(buf + preliminary, buf + len);
-        if (new_max > max) max = new_max;
-    }
-    
-    // create helper array
-    helper = scratch.alloc<u32>(len);
-
-    // while (bits_evaluated < bits_to_evaluate && max_has_bits_to_evaluate)
-    while(exp < (sizeof(u32) << 3) && (max >> exp) > 0) {
-
-        u32 *vec = buf, *help = helper;
-        if (swap) {
-            vec = helper;
-            help = buf;
-        }
+// == SERIAL ===========================================================================================================
 
-        // Core algorithm: for a specific byte, fill the buckets array,
-        // rearrange the array and reset the initial array accordingly.
-
-        u32 bucket[256] = {0};
-        u8 *beg = (u8*)(vec) + radix__bits_to_byte(exp);
-        u8 *end = (u8*)(&vec[len & 0xfffffffc]);
-        
-        // to add to the bucket, we process 4 u32 at a time
-        // (this is why we mask out the 2 least significant bits in size, if size < 4 -> end <= beg)
-        // we set the bucket (++bucket[*beg]), then we skip to the next u32 (beg += sizeof(u32))
-        while(beg < end) {
-            ++bucket[*beg]; beg += sizeof(u32);
-            ++bucket[*beg]; beg += sizeof(u32);
-            ++bucket[*beg]; beg += sizeof(u32);
-            ++bucket[*beg]; beg += sizeof(u32);
-        }
-        // then we add what is left byte by byte
-        beg = (u8*)(&vec[len & 0xfffffffc]) + (exp >> 3);
-        end = (u8*)(&vec[len]);
-        while(beg < end) {
-            ++bucket[*beg]; beg += sizeof(u32);
+template<SortKey ktype, u32 kstride>
+static void radix__sort(byte *data, u32 len, u32 stride, u32 key_offset, Arena &scratch) {
+    constexpr u32 pass_count = radix__pass_count<ktype>;
+
+    if (len < 2) {
+        return;
+    }
+
+    // histograms for every pass in one go, the counts don't change between passes
+    u32 hist[pass_count][256] = {};
+    for (u32 i = 0; i < len; ++i) {
+        u64 key = radix__load_key<ktype>(data + (usize)i * stride + key_offset);
+        for (u32 p = 0; p < pass_count; ++p) {
+            ++hist[p][(key >> (p * 8)) & 0xFF];
         }
-        // check if the current byte is the same in the whole buffer
-        bool next = false;
-        for(u32 i = 0; i < 256; ++i) {
-            if(bucket[i] == len) {
-                next = true;
-                break;
-            }
+    }
+
+    // the temporary buffer is given back before returning
+    const usize scratch_start = scratch.tell();
+    byte *src = data;
+    byte *dst = nullptr;
+
+    for (u32 p = 0; p < pass_count; ++p) {
+        u32 *counts = hist[p];
+        const u64 shift = p * 8;
+
+        // every key has the same byte here, the pass wouldn't move anything
+        if (counts[(radix__load_key<ktype>(src + key_offset) >> shift) & 0xFF] == len) {
+            continue;
         }
-        if(next) {
-            exp += 8;
-            return;
+
+        if (!dst) {
+            dst = (byte *)scratch.alloc(stride, len, 16, Arena::NoZero);
         }
-        // map bucket to helper (final) array
-        for(u32 i = 0; i < 256; help += bucket[i++]) {
-            point[i] = help;
+
+        u32 offset = 0;
+        for (u32 d = 0; d < 256; ++d) {
+            u32 count = counts[d];
+            counts[d] = offset;
+            offset += count;
         }
-        // 
-        for(help = vec; help < &vec[len]; ++help) {
-            u8 cur_byte = (*help >> exp) & 0xFF;
-            *point[cur_byte] = *help; 
-            point[cur_byte]++; 
+
+        for (u32 i = 0; i < len; ++i) {
+            const byte *rec = src + (usize)i * stride;
+            const u32 digit = (radix__load_key<ktype>(rec + key_offset) >> shift) & 0xFF;
+            radix__copy<kstride>(dst + (usize)counts[digit]++ * stride, rec, stride);
         }
-        swap = !swap;
-        exp += 8;
+
+        mem::swap(src, dst);
     }
 
-    if(swap) {
-	    memcpy(buf, helper, sizeof(u32) * len);
+    if (src != data) {
+        memcpy(data, src, (usize)len * stride);
     }
+
+    scratch.rewind(scratch_start);
 }
 
-void radixSort(void *data, u32 len, u32 stride) {
-    Arena temp = Arena::make(stride * len, Arena::Malloc);
-    radixSort(data, len, stride, temp);
-}
-
-void radixSort(void *data, u32 len, u32 stride, Arena scratch) {
-    u8 *buf = (u8 *)data;
-
-    // bits sorted
-    u32 exp = 0;
-    // array of pointers to the helper array
-    u8 *point[256];
-    bool swap = false;
-
-    // Define std preliminary, constrain and expression to check if all bytes are sorted
-    // Set preliminary according to size
-    const u32 preliminary = (len > 100) ? 100 : (len >> 3);
-    
-    // If we found a integer with more than 24 bits in preliminar,
-    // will have to sort all bytes either way, so max = max_uint
-    u32 max = radix__find_max(buf + 1 * stride, buf + preliminary * stride, stride);
-    if (max <= (UINT_MAX >> 8)) {
-        u32 new_max = radix__find_max(buf + preliminary * stride, buf + len * stride, stride);
-        if (new_max > max) max = new_max;
-    }
-
-    // create helper array
-    u8 *helper = scratch.alloc<u8>(len * stride);
-
-    // while (bits_evaluated < bits_to_evaluate && max_has_bits_to_evaluate)
-    while (exp < (sizeof(u32) << 3) && (max >> exp) > 0) {
-        u8 *vec = buf, *help = helper;
-        if (swap) {
-            vec = helper;
-            help = buf;
-        }
+template<SortKey ktype>
+static void radix__sort_records(byte *data, u32 len, u32 stride, u32 key_offset, Arena &scratch) {
+    switch (stride) {
+        case 4:  radix__sort<ktype, 4>(data, len, stride, key_offset, scratch); break;
+        case 8:  radix__sort<ktype, 8>(data, len, stride, key_offset, scratch); break;
+        case 16: radix__sort<ktype, 16>(data, len, stride, key_offset, scratch); break;
+        default: radix__sort<ktype, 0>(data, len, stride, key_offset, scratch); break;
+    }
+}
 
-        // Core algorithm: for a specific byte, fill the buckets array,
-        // rearrange the array and reset the initial array accordingly.
-
-        u32 bucket[256] = {0};
-        u8 *beg = vec + radix__bits_to_byte(exp) * stride;
-        u8 *end = vec + (len & 0xFFFFFFFC) * stride;
-        
-        // to add to the bucket, we process 4 u32 at a time
-        // (this is why we mask out the 2 least significant bits in size, if size < 4 -> end <= beg)
-        // we set the bucket (++bucket[*beg]), then we skip to the next u32 (beg += sizeof(u32))
-        while (beg < end) {
-            ++bucket[*beg]; beg += stride;
-            ++bucket[*beg]; beg += stride;
-            ++bucket[*beg]; beg += stride;
-            ++bucket[*beg]; beg += stride;
-        }
-        // then we add what is left byte by byte
-        beg = vec + ((len & 0xFFFFFFFC) + (exp >> 3)) * stride;
-        end = vec + len * stride;
-        while (beg < end) {
-            ++bucket[*beg]; beg += stride;
+static void radix__sort_records(void *data, u32 len, u32 stride, u32 key_offset, SortKey key_type, Arena &scratch) {
+    pk_assert(stride > 0);
+    pk_assert(key_offset + (key_type == SortKey::U64 ? 8 : 4) <= stride);
+
+    switch (key_type) {
+        case SortKey::U32: radix__sort_records<SortKey::U32>((byte *)data, len, stride, key_offset, scratch); break;
+        case SortKey::U64: radix__sort_records<SortKey::U64>((byte *)data, len, stride, key_offset, scratch); break;
+        case SortKey::F32: radix__sort_records<SortKey::F32>((byte *)data, len, stride, key_offset, scratch); break;
+    }
+}
+
+// == PARALLEL =========================================================================================================
+
+// the array is split in chunks, each one counts its own digits and scatters its own records.
+// chunk c writes its records for digit d after every record with a smaller digit and after
+// the records for digit d of the chunks before it, which keeps the sort stable.
+// the buffers are not taken from the scratch arena, the calling job could be resumed on
+// another thread while it waits for the workers
+template<SortKey ktype, u32 kstride>
+static void radix__sort_parallel(ThreadPool &pool, byte *data, u32 len, u32 stride, u32 key_offset) {
+    constexpr u32 pass_count = radix__pass_count<ktype>;
+
+    if (len < radix__parallel_min) {
+        ScratchScope scratch = Arena::scratch();
+        radix__sort<ktype, kstride>(data, len, stride, key_offset, *scratch);
+        return;
+    }
+
+    const u32 chunk_count = (u32)math::min<usize>(pool.getNumOfThreads() + 1, radix__max_chunks);
+    const u32 chunk_len = (len + chunk_count - 1) / chunk_count;
+
+    // per chunk histograms for every pass, only used to skip the passes that wouldn't move anything
+    const usize totals_size = sizeof(u32) * chunk_count * pass_count * 256;
+    const usize offsets_size = sizeof(u32) * chunk_count * 256;
+    byte *block = (byte *)pk_malloc(totals_size + offsets_size + (usize)len * stride);
+    pk_assert(block);
+    memset(block, 0, totals_size);
+
+    u32 (*totals)[256] = (u32 (*)[256])block;
+    pool.parallelFor(0, chunk_count, 1, [&](usize chunk_begin, usize chunk_end) {
+        for (usize c = chunk_begin; c < chunk_end; ++c) {
+            u32 (*hist)[256] = totals + c * pass_count;
+            const u32 begin = (u32)c * chunk_len;
+            const u32 end = math::min(begin + chunk_len, len);
+            for (u32 i = begin; i < end; ++i) {
+                u64 key = radix__load_key<ktype>(data + (usize)i * stride + key_offset);
+                for (u32 p = 0; p < pass_count; ++p) {
+                    ++hist[p][(key >> (p * 8)) & 0xFF];
+                }
+            }
         }
-        // check if the current byte is the same in the whole buffer
-        bool next = false;
-        for (u32 i = 0; i < 256; ++i) {
-            if(bucket[i] == len) {
-                next = true;
+    });
+
+    bool skip[pass_count] = {};
+    for (u32 p = 0; p < pass_count; ++p) {
+        for (u32 d = 0; d < 256; ++d) {
+            u32 total = 0;
+            for (u32 c = 0; c < chunk_count; ++c) {
+                total += totals[c * pass_count + p][d];
+            }
+            if (total == len) {
+                skip[p] = true;
+                break;
+            }
+            if (total) {
                 break;
             }
         }
-        if (next) {
-            exp += 8;
-            return;
-        }
-        // map bucket to helper (final) array
-        for (u32 i = 0; i < 256; help += (bucket[i++] * stride)) {
-            point[i] = help;
+    }
+
+    // per chunk histogram of the current pass, it has to be recounted every pass as the records move between chunks
+    u32 (*offsets)[256] = (u32 (*)[256])(block + totals_size);
+    byte *src = data;
+    byte *dst = block + totals_size + offsets_size;
+
+    for (u32 p = 0; p < pass_count; ++p) {
+        if (skip[p]) {
+            continue;
         }
-        beg = vec;
-        end = vec + len * stride;
-        for (; beg < end; beg += stride) {
-            u32 value = *(u32*)beg;
-            u8 cur_byte = (value >> exp) & 0xFF;
-            *point[cur_byte] = value; 
-            point[cur_byte] += stride; 
+
+        const u64 shift = p * 8;
+
+        pool.parallelFor(0, chunk_count, 1, [&](usize chunk_begin, usize chunk_end) {
+            for (usize c = chunk_begin; c < chunk_end; ++c) {
+                u32 *counts = offsets[c];
+                memset(counts, 0, sizeof(offsets[c]));
+                const u32 begin = (u32)c * chunk_len;
+                const u32 end = math::min(begin + chunk_len, len);
+                for (u32 i = begin; i < end; ++i) {
+                    ++counts[(radix__load_key<ktype>(src + (usize)i * stride + key_offset) >> shift) & 0xFF];
+                }
+            }
+        });
+
+        u32 offset = 0;
+        for (u32 d = 0; d < 256; ++d) {
+            for (u32 c = 0; c < chunk_count; ++c) {
+                u32 count = offsets[c][d];
+                offsets[c][d] = offset;
+                offset += count;
+            }
         }
-        swap = !swap;
-        exp += 8;
+
+        pool.parallelFor(0, chunk_count, 1, [&](usize chunk_begin, usize chunk_end) {
+            for (usize c = chunk_begin; c < chunk_end; ++c) {
+                u32 *counts = offsets[c];
+                const u32 begin = (u32)c * chunk_len;
+                const u32 end = math::min(begin + chunk_len, len);
+                for (u32 i = begin; i < end; ++i) {
+                    const byte *rec = src + (usize)i * stride;
+                    const u32 digit = (radix__load_key<ktype>(rec + key_offset) >> shift) & 0xFF;
+                    radix__copy<kstride>(dst + (usize)counts[digit]++ * stride, rec, stride);
+                }
+            }
+        });
+
+        mem::swap(src, dst);
+    }
+
+    if (src != data) {
+        pool.parallelFor(0, len, radix__parallel_min, [&](usize begin, usize end) {
+            memcpy(data + begin * stride, src + begin * stride, (end - begin) * stride);
+        });
+    }
+
+    pk_free(block);
+}
+
+template<SortKey ktype>
+static void radix__sort_parallel_records(ThreadPool &pool, byte *data, u32 len, u32 stride, u32 key_offset) {
+    switch (stride) {
+        case 8:  radix__sort_parallel<ktype, 8>(pool, data, len, stride, key_offset); break;
+        case 16: radix__sort_parallel<ktype, 16>(pool, data, len, stride, key_offset); break;
+        default: radix__sort_parallel<ktype, 0>(pool, data, len, stride, key_offset); break;
     }
+}
+
+// == PUBLIC FUNCTIONS =================================================================================================
+
+void radixSort(u32 *buf, u32 len) {
+    ScratchScope scratch = Arena::scratch();
+    radixSort(buf, len, *scratch);
+}
+
+void radixSort(u32 *buf, u32 len, Arena &scratch) {
+    radix__sort<SortKey::U32, sizeof(u32)>((byte *)buf, len, sizeof(u32), 0, scratch);
+}
+
+void radixSort(u64 *buf, u32 len) {
+    ScratchScope scratch = Arena::scratch();
+    radixSort(buf, len, *scratch);
+}
+
+void radixSort(u64 *buf, u32 len, Arena &scratch) {
+    radix__sort<SortKey::U64, sizeof(u64)>((byte *)buf, len, sizeof(u64), 0, scratch);
+}
+
+void radixSort(float *buf, u32 len) {
+    ScratchScope scratch = Arena::scratch();
+    radixSort(buf, len, *scratch);
+}
+
+void radixSort(float *buf, u32 len, Arena &scratch) {
+    radix__sort<SortKey::F32, sizeof(float)>((byte *)buf, len, sizeof(float), 0, scratch);
+}
+
+void radixSort(SortPair *buf, u32 len) {
+    ScratchScope scratch = Arena::scratch();
+    radixSort(buf, len, *scratch);
+}
+
+void radixSort(SortPair *buf, u32 len, Arena &scratch) {
+    radix__sort<SortKey::U64, sizeof(SortPair)>((byte *)buf, len, sizeof(SortPair), 0, scratch);
+}
+
+void radixSort(void *data, u32 len, u32 stride) {
+    ScratchScope scratch = Arena::scratch();
+    radix__sort_records(data, len, stride, 0, SortKey::U32, *scratch);
+}
+
+void radixSort(void *data, u32 len, u32 stride, Arena &scratch) {
+    radix__sort_records(data, len, stride, 0, SortKey::U32, scratch);
+}
+
+void radixSort(void *data, u32 len, u32 stride, u32 key_offset, SortKey key_type) {
+    ScratchScope scratch = Arena::scratch();
+    radix__sort_records(data, len, stride, key_offset, key_type, *scratch);
+}
+
+void radixSort(void *data, u32 len, u32 stride, u32 key_offset, SortKey key_type, Arena &scratch) {
+    radix__sort_records(data, len, stride, key_offset, key_type, scratch);
+}
+
+void radixSortParallel(ThreadPool &pool, u64 *buf, u32 len) {
+    radix__sort_parallel<SortKey::U64, sizeof(u64)>(pool, (byte *)buf, len, sizeof(u64), 0);
+}
+
+void radixSortParallel(ThreadPool &pool, SortPair *buf, u32 len) {
+    radix__sort_parallel<SortKey::U64, sizeof(SortPair)>(pool, (byte *)buf, len, sizeof(SortPair), 0);
+}
+
+void radixSortParallel(ThreadPool &pool, void *data, u32 len, u32 stride, u32 key_offset, SortKey key_type) {
+    pk_assert(stride > 0);
+    pk_assert(key_offset + (key_type == SortKey::U64 ? 8 : 4) <= stride);
 
-    if (swap) {
-	    memcpy(buf, helper, stride * len);
+    switch (key_type) {
+        case SortKey::U32: radix__sort_parallel_records<SortKey::U32>(pool, (byte *)data, len, stride, key_offset); break;
+        case SortKey::U64: radix__sort_parallel_records<SortKey::U64>(pool, (byte *)data, len, stride, key_offset); break;
+        case SortKey::F32: radix__sort_parallel_records<SortKey::F32>(pool, (byte *)data, len, stride, key_offset); break;
     }
 }
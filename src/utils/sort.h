@@ -4,8 +4,47 @@
 #include "std/slice.h"
 #include "std/arena.h"
 
+struct ThreadPool;
+
+// all the sorts are stable LSD radix sorts. the temporary buffer comes from the scratch
+// arena if one is passed, otherwise from the thread's scratch arena. either way the arena is
+// rewound to where it was before returning
+
+enum class SortKey : u8 {
+    U32,
+    U64,
+    // negative numbers go before positive ones and -0 goes before +0
+    F32,
+};
+
+// a key and the index of what it refers to, cheaper to sort than the records themselves
+struct SortPair {
+    u64 key;
+    u32 index;
+};
+
 void radixSort(u32 *buf, u32 len);
-void radixSort(u32 *buf, u32 len, Arena scratch);
+void radixSort(u32 *buf, u32 len, Arena &scratch);
+
+void radixSort(u64 *buf, u32 len);
+void radixSort(u64 *buf, u32 len, Arena &scratch);
 
+void radixSort(float *buf, u32 len);
+void radixSort(float *buf, u32 len, Arena &scratch);
+
+void radixSort(SortPair *buf, u32 len);
+void radixSort(SortPair *buf, u32 len, Arena &scratch);
+
+// sorts records of stride bytes by the u32 at the start of every record, the whole record is moved
 void radixSort(void *data, u32 len, u32 stride);
-void radixSort(void *data, u32 len, u32 stride, Arena scratch);
\ No newline at end of file
+void radixSort(void *data, u32 len, u32 stride, Arena &scratch);
+
+// same, but the key can be anywhere in the record
+void radixSort(void *data, u32 len, u32 stride, u32 key_offset, SortKey key_type);
+void radixSort(void *data, u32 len, u32 stride, u32 key_offset, SortKey key_type, Arena &scratch);
+
+// every pass is split between the pool's workers and the calling thread, each chunk of the
+// array gets its own histogram. small arrays are sorted on the calling thread
+void radixSortParallel(ThreadPool &pool, u64 *buf, u32 len);
+void radixSortParallel(ThreadPool &pool, SortPair *buf, u32 len);
+void radixSortParallel(ThreadPool &pool, void *data, u32 len, u32 stride, u32 key_offset, SortKey key_type);
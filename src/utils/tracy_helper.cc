@@ -1,9 +1,12 @@
 #include "tracy_helper.h"
 
+#include <stdio.h>
 #include <vulkan/vulkan.h>
 #include <tracy/Tracy.hpp>
 #include <tracy/TracyVulkan.hpp>
 
+#include "std/memtrack.h"
+
 #include "gfx/engine.h"
 
 void Tracy::init() {
@@ -36,4 +39,36 @@ void Tracy::cleanup() {
     for (void *ctx : ctxs) {
         TracyVkDestroy((tracy::VkCtx *)ctx);
     }
-}
\ No newline at end of file
+}
+void Tracy::plotMemory() {
+    if (!memtrack::isEnabled()) {
+        return;
+    }
+
+    // tracy keeps the pointer to the plot name, so they need to stay around
+    static char plot_names[(int)MemTag::Count][2][32];
+    static u64 last_alloc_count[(int)MemTag::Count] = {};
+    static bool names_init = false;
+    if (!names_init) {
+        for (int i = 0; i < (int)MemTag::Count; ++i) {
+            const char *tag = memtrack::getTagName((MemTag)i);
+            snprintf(plot_names[i][0], sizeof(plot_names[i][0]), "mem %s", tag);
+            snprintf(plot_names[i][1], sizeof(plot_names[i][1]), "mem %s allocs", tag);
+            TracyPlotConfig(plot_names[i][0], tracy::PlotFormatType::Memory, true, true, 0);
+        }
+        TracyPlotConfig("mem arena reserved", tracy::PlotFormatType::Memory, true, true, 0);
+        TracyPlotConfig("mem arena committed", tracy::PlotFormatType::Memory, true, true, 0);
+        names_init = true;
+    }
+
+    for (int i = 0; i < (int)MemTag::Count; ++i) {
+        memtrack::TagStats stats = memtrack::getTagStats((MemTag)i);
+        TracyPlot(plot_names[i][0], (int64_t)stats.live_bytes);
+        TracyPlot(plot_names[i][1], (int64_t)(stats.alloc_count - last_alloc_count[i]));
+        last_alloc_count[i] = stats.alloc_count;
+    }
+
+    memtrack::ArenaStats arena_stats = memtrack::getArenaStats();
+    TracyPlot("mem arena reserved", (int64_t)arena_stats.reserved);
+    TracyPlot("mem arena committed", (int64_t)arena_stats.committed);
+}
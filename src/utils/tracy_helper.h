@@ -6,6 +6,8 @@ struct Tracy {
     void init();
     void *getCtx(u32 frame);
     void cleanup();
+    // memory used by each subsystem and by the arenas, needs PK_TRACK_ALLOCS. call once per frame
+    void plotMemory();
 
     arr<void *> ctxs;
 };
\ No newline at end of file